@@ -49,6 +49,25 @@ void print_move(mcumax_move move) {
   }
 }
 
+// A slow display (e-paper, SPI TFT) only redraws the squares changed by
+// the moves played; here they are printed
+void print_changed_squares(uint64_t changed_squares) {
+  const char *symbols = ".PPNKBRQ.ppnkbrq";
+
+  Serial.print("Changed squares:");
+  for (mcumax_square square = 0; square < 0x80; square = (square + 9) & ~0x08) {
+    if (changed_squares & MCUMAX_SQUARE_BIT(square)) {
+      Serial.print(' ');
+      print_square(square);
+      Serial.print('=');
+      Serial.print(symbols[mcumax_get_piece(square)]);
+    }
+  }
+  Serial.println("");
+  Serial.println("");
+  Serial.print("Move: ");
+}
+
 mcumax_square get_square(char *s) {
   mcumax_square rank = s[0] - 'a';
   if (rank > 7)
@@ -131,16 +150,28 @@ void loop() {
       (valid_moves[i].to == move.to))
       is_valid_move = true;
 
+  uint64_t changed_squares = 0;
+
   if (!is_valid_move || !mcumax_play_move(move))
     Serial.println("Invalid move.");
   else {
+    changed_squares |= mcumax_get_changed_squares();
+
     mcumax_move move = mcumax_search_best_move(MCUMAX_NODE_MAX, MCUMAX_DEPTH_MAX);
     if (move.from == MCUMAX_SQUARE_INVALID)
       Serial.println("Game over.");
     else if (mcumax_play_move(move)) {
+      changed_squares |= mcumax_get_changed_squares();
+
       Serial.print("Opponent moves: ");
       print_move(move);
       Serial.println("");
+
+      // Keeps the changed squares of the move
+      if (mcumax_is_in_checkmate(mcumax_get_current_side()))
+        Serial.println("Checkmate.");
+      else if (mcumax_is_stalemate(mcumax_get_current_side()))
+        Serial.println("Stalemate.");
     }
   }
 
@@ -148,5 +179,5 @@ void loop() {
 
   digitalWrite(LED_BUILTIN, LOW);
 
-  print_board();
+  print_changed_squares(changed_squares);
 }
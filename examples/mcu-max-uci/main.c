@@ -6,14 +6,39 @@
  * License: MIT
  */
 
+#define _POSIX_C_SOURCE 199309L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "mcu-max.h"
+#include "perf.h"
 
 #define MAIN_VALID_MOVES_NUM 512
 
+#define BENCH_DEPTH_DEFAULT 6
+#define BENCH_NODES_DEFAULT 200000
+
+typedef struct
+{
+    const char *fen;
+    const char *best_move;
+} bench_position;
+
+// Bench positions; a best move marks a tactical test position
+static const bench_position bench_positions[] = {
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", NULL},
+    {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", NULL},
+    {"r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4", NULL},
+    {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", NULL},
+    {"2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1", "g3g6"},
+    {"8/7p/5k2/5p2/p1p2P2/Pr1pPK2/1P1R3P/8 b - - 0 1", "b3b2"},
+    {"r1bq2rk/pp3pbp/2p1p1pQ/7P/3P4/2PB1N2/PP3PPR/2KR4 w - - 0 1", "h6h7"},
+    {"5k2/6pp/p1qN4/1p1p4/3P4/2PKP2Q/PP3r2/3R4 b - - 0 1", "c6c4"},
+};
+
 void print_board()
 {
     const char *symbols = ".PPNKBRQ.ppnkbrq";
@@ -76,6 +101,202 @@ void print_move(mcumax_move move)
     }
 }
 
+double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+void move_to_string(mcumax_move move, char *s)
+{
+    s[0] = 'a' + (move.from & 0x07);
+    s[1] = '1' + 7 - ((move.from & 0x70) >> 4);
+    s[2] = 'a' + (move.to & 0x07);
+    s[3] = '1' + 7 - ((move.to & 0x70) >> 4);
+    s[4] = '\0';
+}
+
+static void print_perf(const perf_counters *counters, uint64_t nodes)
+{
+    printf("perf");
+    for (uint32_t i = 0; i < PERF_COUNTERS_NUM; i++)
+    {
+        if (perf_is_open(counters, i))
+            printf(" %s %.1f", perf_counter_names[i],
+                   nodes ? (double)counters->values[i] / nodes : 0);
+        else
+            printf(" %s n/a", perf_counter_names[i]);
+    }
+    printf(" (per node)\n");
+
+    if (perf_is_open(counters, PERF_CYCLES) &&
+        perf_is_open(counters, PERF_INSTRUCTIONS) &&
+        counters->values[PERF_CYCLES])
+        printf("perf IPC %.2f\n",
+               (double)counters->values[PERF_INSTRUCTIONS] / counters->values[PERF_CYCLES]);
+}
+
+double run_bench(uint32_t depth_max, uint32_t node_max, bool perf_enabled)
+{
+    uint32_t positions_num = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    uint64_t total_nodes = 0;
+    double total_time = 0;
+    uint32_t tactics_num = 0;
+    uint32_t tactics_solved = 0;
+#ifdef MCUMAX_HASH_STATS_ENABLED
+    uint64_t hash_probe_count = 0;
+    uint64_t hash_hit_count = 0;
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+    uint64_t hash_near_hit_count = 0;
+#endif
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    uint64_t hash_verified_count = 0;
+    uint64_t hash_alias_count = 0;
+    uint64_t hash_collision_count = 0;
+    uint64_t hash_collision_used_count = 0;
+#endif
+#endif
+#ifdef MCUMAX_REPETITION_ENABLED
+    uint64_t repetition_cut_count = 0;
+#endif
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    uint64_t iteration_skip_count = 0;
+    uint64_t iteration_skip_nodes = 0;
+#endif
+#ifdef MCUMAX_PROBCUT_ENABLED
+    uint64_t probcut_try_count = 0;
+    uint64_t probcut_cut_count = 0;
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    uint64_t eval_full_count = 0;
+    uint64_t eval_lazy_count = 0;
+#endif
+    perf_counters counters;
+
+    if (perf_enabled && !perf_open(&counters))
+    {
+        printf("perf counters unavailable\n");
+
+        perf_enabled = false;
+    }
+
+    for (uint32_t i = 0; i < positions_num; i++)
+    {
+        const bench_position *position = &bench_positions[i];
+
+        mcumax_set_fen_position(position->fen);
+
+        if (perf_enabled)
+            perf_start(&counters);
+        double start_time = get_time();
+        mcumax_move move = mcumax_search_best_move(node_max, depth_max);
+        double elapsed_time = get_time() - start_time;
+        if (perf_enabled)
+            perf_stop(&counters);
+
+        char move_string[5];
+        move_to_string(move, move_string);
+
+        printf("%2u: nodes %10u time %8.3f s bestmove %s",
+               i + 1, mcumax.node_count, elapsed_time, move_string);
+        if (position->best_move)
+        {
+            bool solved = !strcmp(move_string, position->best_move);
+
+            tactics_num++;
+            tactics_solved += solved;
+
+            printf(" (expected %s%s)", position->best_move, solved ? "" : ", missed");
+        }
+        printf("\n");
+
+        total_nodes += mcumax.node_count;
+        total_time += elapsed_time;
+#ifdef MCUMAX_HASH_STATS_ENABLED
+        hash_probe_count += mcumax.hash_probe_count;
+        hash_hit_count += mcumax.hash_hit_count;
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+        hash_near_hit_count += mcumax.hash_near_hit_count;
+#endif
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+        hash_verified_count += mcumax.hash_verified_count;
+        hash_alias_count += mcumax.hash_alias_count;
+        hash_collision_count += mcumax.hash_collision_count;
+        hash_collision_used_count += mcumax.hash_collision_used_count;
+#endif
+#endif
+#ifdef MCUMAX_REPETITION_ENABLED
+        repetition_cut_count += mcumax.repetition_cut_count;
+#endif
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+        iteration_skip_count += mcumax.iteration_skip_count;
+        iteration_skip_nodes += mcumax.iteration_skip_nodes;
+#endif
+#ifdef MCUMAX_PROBCUT_ENABLED
+        probcut_try_count += mcumax.probcut_try_count;
+        probcut_cut_count += mcumax.probcut_cut_count;
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+        eval_full_count += mcumax.eval_full_count;
+        eval_lazy_count += mcumax.eval_lazy_count;
+#endif
+    }
+
+    printf("nodes %llu time %.3f s nps %.0f solved %u/%u\n",
+           (unsigned long long)total_nodes,
+           total_time,
+           total_time > 0 ? total_nodes / total_time : 0,
+           tactics_solved,
+           tactics_num);
+#ifdef MCUMAX_HASH_STATS_ENABLED
+    printf("hash probes %llu hits %llu (%.1f%%)",
+           (unsigned long long)hash_probe_count,
+           (unsigned long long)hash_hit_count,
+           hash_probe_count ? 100.0 * hash_hit_count / hash_probe_count : 0);
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+    printf(" near hits %llu", (unsigned long long)hash_near_hit_count);
+#endif
+    printf("\n");
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    printf("hash verified %llu aliases %llu collisions %llu (%.2f per million probes) used %llu\n",
+           (unsigned long long)hash_verified_count,
+           (unsigned long long)hash_alias_count,
+           (unsigned long long)hash_collision_count,
+           hash_probe_count ? 1E6 * hash_collision_count / hash_probe_count : 0,
+           (unsigned long long)hash_collision_used_count);
+#endif
+#endif
+#ifdef MCUMAX_REPETITION_ENABLED
+    printf("repetition cuts %llu\n", (unsigned long long)repetition_cut_count);
+#endif
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    printf("iterations skipped %llu predicted nodes %llu\n",
+           (unsigned long long)iteration_skip_count,
+           (unsigned long long)iteration_skip_nodes);
+#endif
+#ifdef MCUMAX_PROBCUT_ENABLED
+    printf("probcut tries %llu cuts %llu\n",
+           (unsigned long long)probcut_try_count,
+           (unsigned long long)probcut_cut_count);
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    printf("eval full %llu lazy %llu\n",
+           (unsigned long long)eval_full_count,
+           (unsigned long long)eval_lazy_count);
+#endif
+    if (perf_enabled)
+    {
+        print_perf(&counters, total_nodes);
+        perf_close(&counters);
+    }
+
+    mcumax_init();
+
+    return total_time;
+}
+
 bool send_uci_command(char *line)
 {
     char *token = strtok(line, " \n");
@@ -113,7 +334,7 @@ bool send_uci_command(char *line)
         int fen_index = 0;
         char fen_string[256];
 
-        while (token = strtok(NULL, " \n"))
+        while ((token = strtok(NULL, " \n")))
         {
             if (fen_index)
             {
@@ -156,6 +377,54 @@ bool send_uci_command(char *line)
         print_move(move);
         printf("\n");
     }
+    else if (!strcmp(token, "bench"))
+    {
+        uint32_t depth_max = BENCH_DEPTH_DEFAULT;
+        uint32_t node_max = BENCH_NODES_DEFAULT;
+#ifdef MCUMAX_PARALLEL_ENABLED
+        uint32_t threads_num = 0;
+#endif
+        bool perf_enabled = false;
+        uint32_t arg_index = 0;
+
+        // bench [depth] [nodes] [threads] [perf]
+        while ((token = strtok(NULL, " \n")))
+        {
+            if (!strcmp(token, "perf"))
+                perf_enabled = true;
+            else
+            {
+                if (arg_index == 0)
+                    depth_max = atoi(token);
+                else if (arg_index == 1)
+                    node_max = atoi(token);
+#ifdef MCUMAX_PARALLEL_ENABLED
+                else if (arg_index == 2)
+                    threads_num = atoi(token);
+#endif
+
+                arg_index++;
+            }
+        }
+
+#ifdef MCUMAX_PARALLEL_ENABLED
+        if (threads_num)
+        {
+            printf("serial:\n");
+            mcumax_set_threads(0);
+            double serial_time = run_bench(depth_max, node_max, perf_enabled);
+
+            printf("%u threads:\n", threads_num);
+            mcumax_set_threads(threads_num);
+            double parallel_time = run_bench(depth_max, node_max, perf_enabled);
+
+            printf("speedup %.2f\n",
+                   parallel_time > 0 ? serial_time / parallel_time : 0);
+        }
+        else
+#endif
+            run_bench(depth_max, node_max, perf_enabled);
+    }
     else if (!strcmp(token, "quit"))
         return true;
     else
@@ -173,7 +442,8 @@ int main()
         fflush(stdout);
 
         char line[65536];
-        fgets(line, sizeof(line), stdin);
+        if (!fgets(line, sizeof(line), stdin))
+            break;
 
         if (send_uci_command(line))
             break;
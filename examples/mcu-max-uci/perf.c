@@ -0,0 +1,151 @@
+/*
+ * mcu-max UCI chess interface example
+ * Hardware performance counters
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include "perf.h"
+
+const char *const perf_counter_names[PERF_COUNTERS_NUM] = {
+    "cycles",
+    "instructions",
+    "branch-misses",
+    "L1d-misses",
+    "LLC-misses",
+};
+
+#if defined(__linux__)
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+} perf_events[PERF_COUNTERS_NUM] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+bool perf_open(perf_counters *counters)
+{
+    bool is_open = false;
+
+    memset(counters, 0, sizeof(*counters));
+
+    for (uint32_t i = 0; i < PERF_COUNTERS_NUM; i++)
+    {
+        struct perf_event_attr attr;
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_events[i].type;
+        attr.config = perf_events[i].config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        // User space only, which unprivileged processes may count
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        counters->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        is_open |= (counters->fds[i] >= 0);
+    }
+
+    return is_open;
+}
+
+void perf_start(perf_counters *counters)
+{
+    for (uint32_t i = 0; i < PERF_COUNTERS_NUM; i++)
+    {
+        if (counters->fds[i] < 0)
+            continue;
+
+        ioctl(counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_stop(perf_counters *counters)
+{
+    for (uint32_t i = 0; i < PERF_COUNTERS_NUM; i++)
+    {
+        // Value, time enabled, time running
+        uint64_t data[3];
+
+        if (counters->fds[i] < 0)
+            continue;
+
+        ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        if ((read(counters->fds[i], data, sizeof(data)) == sizeof(data)) &&
+            data[2])
+            counters->values[i] += (data[2] < data[1])
+                                       ? (uint64_t)((double)data[0] * data[1] / data[2])
+                                       : data[0];
+    }
+}
+
+void perf_close(perf_counters *counters)
+{
+    for (uint32_t i = 0; i < PERF_COUNTERS_NUM; i++)
+    {
+        if (counters->fds[i] >= 0)
+            close(counters->fds[i]);
+
+        counters->fds[i] = -1;
+    }
+}
+
+#else
+
+bool perf_open(perf_counters *counters)
+{
+    memset(counters, 0, sizeof(*counters));
+
+    for (uint32_t i = 0; i < PERF_COUNTERS_NUM; i++)
+        counters->fds[i] = -1;
+
+    return false;
+}
+
+void perf_start(perf_counters *counters)
+{
+    (void)counters;
+}
+
+void perf_stop(perf_counters *counters)
+{
+    (void)counters;
+}
+
+void perf_close(perf_counters *counters)
+{
+    (void)counters;
+}
+
+#endif
+
+bool perf_is_open(const perf_counters *counters, uint32_t index)
+{
+    return counters->fds[index] >= 0;
+}
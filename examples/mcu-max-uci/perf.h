@@ -0,0 +1,67 @@
+/*
+ * mcu-max UCI chess interface example
+ * Hardware performance counters
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(PERF_H)
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_BRANCH_MISSES,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+
+    PERF_COUNTERS_NUM,
+};
+
+typedef struct
+{
+    int fds[PERF_COUNTERS_NUM];
+    // Counts, scaled up when the kernel multiplexed the counter
+    uint64_t values[PERF_COUNTERS_NUM];
+} perf_counters;
+
+extern const char *const perf_counter_names[PERF_COUNTERS_NUM];
+
+/**
+ * @brief Opens the counters for the calling process and its later threads.
+ *
+ * Counters the kernel refuses (no PMU, as in most containers and VMs, or
+ * perf_event_paranoid too strict) stay closed; without Linux, all do.
+ *
+ * @param counters The counters.
+ * @return At least one counter is open.
+ */
+bool perf_open(perf_counters *counters);
+
+/**
+ * @brief Checks if a counter is open.
+ */
+bool perf_is_open(const perf_counters *counters, uint32_t index);
+
+/**
+ * @brief Starts counting.
+ */
+void perf_start(perf_counters *counters);
+
+/**
+ * @brief Stops counting and adds the counts since perf_start() to the values.
+ */
+void perf_stop(perf_counters *counters);
+
+/**
+ * @brief Closes the counters.
+ */
+void perf_close(perf_counters *counters);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * mcu-max
+ * Threading shim for parallel search
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ *
+ * Backends:
+ * - POSIX threads (default).
+ * - FreeRTOS (MCUMAX_THREAD_FREERTOS), e.g. ESP-IDF or the RP2040 SMP port.
+ *   Engine state is thread-local (MCUMAX_THREAD_LOCAL), so the toolchain
+ *   must switch thread-local storage per task (ESP-IDF does;
+ *   configUSE_C_RUNTIME_TLS_SUPPORT on FreeRTOS 10.6 and later).
+ *   This backend has only been compile-checked, not run on hardware.
+ *
+ * The parallel search only uses this interface: porting to another RTOS
+ * means adding a backend here.
+ */
+
+#if !defined(MCU_MAX_THREAD_H)
+#define MCU_MAX_THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*mcumax_thread_function)(void *);
+
+#if defined(MCUMAX_THREAD_FREERTOS)
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#else
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+#endif
+
+// Worker stack size in bytes
+#ifndef MCUMAX_THREAD_STACK_SIZE
+#define MCUMAX_THREAD_STACK_SIZE 8192
+#endif
+#ifndef MCUMAX_THREAD_PRIORITY
+#define MCUMAX_THREAD_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
+// ESP-IDF specifies task stacks in bytes, FreeRTOS in words
+#ifdef ESP_PLATFORM
+#define MCUMAX_THREAD_STACK_DEPTH MCUMAX_THREAD_STACK_SIZE
+#else
+#define MCUMAX_THREAD_STACK_DEPTH (MCUMAX_THREAD_STACK_SIZE / sizeof(StackType_t))
+#endif
+
+typedef struct
+{
+    mcumax_thread_function function;
+    void *arg;
+    SemaphoreHandle_t done;
+} mcumax_thread;
+
+static inline void mcumax_thread_entry(void *arg)
+{
+    mcumax_thread *thread = arg;
+
+    thread->function(thread->arg);
+
+    // FreeRTOS has no join: signal completion and delete the task
+    xSemaphoreGive(thread->done);
+    vTaskDelete(NULL);
+}
+
+static inline bool mcumax_thread_create(mcumax_thread *thread,
+                                        mcumax_thread_function function,
+                                        void *arg)
+{
+    thread->function = function;
+    thread->arg = arg;
+    thread->done = xSemaphoreCreateBinary();
+    if (!thread->done)
+        return false;
+
+    if (xTaskCreate(mcumax_thread_entry,
+                    "mcumax",
+                    MCUMAX_THREAD_STACK_DEPTH,
+                    thread,
+                    MCUMAX_THREAD_PRIORITY,
+                    NULL) != pdPASS)
+    {
+        vSemaphoreDelete(thread->done);
+
+        return false;
+    }
+
+    return true;
+}
+
+static inline void mcumax_thread_join(mcumax_thread *thread)
+{
+    xSemaphoreTake(thread->done, portMAX_DELAY);
+    vSemaphoreDelete(thread->done);
+}
+
+// Read-modify-write atomics: Cortex-M0+ (RP2040) has no atomic instructions
+#ifdef ESP_PLATFORM
+static portMUX_TYPE mcumax_atomic_mux = portMUX_INITIALIZER_UNLOCKED;
+
+#define MCUMAX_ATOMIC_ENTER() taskENTER_CRITICAL(&mcumax_atomic_mux)
+#define MCUMAX_ATOMIC_EXIT() taskEXIT_CRITICAL(&mcumax_atomic_mux)
+#else
+#define MCUMAX_ATOMIC_ENTER() taskENTER_CRITICAL()
+#define MCUMAX_ATOMIC_EXIT() taskEXIT_CRITICAL()
+#endif
+
+static inline uint32_t mcumax_atomic_fetch_add(uint32_t *value, uint32_t increment)
+{
+    MCUMAX_ATOMIC_ENTER();
+    uint32_t old_value = *(volatile uint32_t *)value;
+    *(volatile uint32_t *)value = old_value + increment;
+    MCUMAX_ATOMIC_EXIT();
+
+    return old_value;
+}
+
+#else
+
+#include <pthread.h>
+
+typedef struct
+{
+    mcumax_thread_function function;
+    void *arg;
+    pthread_t handle;
+} mcumax_thread;
+
+static inline void *mcumax_thread_entry(void *arg)
+{
+    mcumax_thread *thread = arg;
+
+    thread->function(thread->arg);
+
+    return NULL;
+}
+
+static inline bool mcumax_thread_create(mcumax_thread *thread,
+                                        mcumax_thread_function function,
+                                        void *arg)
+{
+    thread->function = function;
+    thread->arg = arg;
+
+    return !pthread_create(&thread->handle, NULL, mcumax_thread_entry, thread);
+}
+
+static inline void mcumax_thread_join(mcumax_thread *thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+static inline uint32_t mcumax_atomic_fetch_add(uint32_t *value, uint32_t increment)
+{
+    return __atomic_fetch_add(value, increment, __ATOMIC_ACQ_REL);
+}
+
+#endif
+
+// Aligned 32-bit loads and stores are atomic on all supported cores
+
+static inline uint32_t mcumax_atomic_load(const uint32_t *value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+static inline void mcumax_atomic_store(uint32_t *value, uint32_t new_value)
+{
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+
+#endif
@@ -14,10 +14,168 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef MCUMAX_PARALLEL_ENABLED
+#include "mcu-max-thread.h"
+#endif
+
 #include "mcu-max.h"
 
 // Configuration
 // #define MCUMAX_HASHING_ENABLED
+// #define MCUMAX_HASH_NEAR_ENABLED
+// #define MCUMAX_HASH_STATS_ENABLED
+// #define MCUMAX_HASH_VERIFY_ENABLED
+// #define MCUMAX_REPETITION_ENABLED
+// #define MCUMAX_PV_ENABLED
+// #define MCUMAX_ITERATION_PREDICTION_ENABLED
+// #define MCUMAX_PROBCUT_ENABLED
+// #define MCUMAX_MOBILITY_ENABLED
+// #define MCUMAX_KING_SAFETY_ENABLED
+// #define MCUMAX_LAZY_EVAL_ENABLED
+// #define MCUMAX_PARALLEL_ENABLED
+// #define MCUMAX_THREAD_LOCAL_ENABLED
+// #define MCUMAX_SPECIALIZED_SEARCH_ENABLED
+// #define MCUMAX_TUNING_ENABLED
+// #define MCUMAX_THREAD_FREERTOS
+
+// Minimal footprint: only the core engine, without FEN export and the
+// check/checkmate/stalemate helpers (see tools/size-report.sh)
+// #define MCUMAX_MINIMAL_ENABLED
+
+// Hashing: main table entries (12 bytes each, 32 on 64-bit hosts with
+// MCUMAX_HASH_VERIFY_ENABLED: 2^24 entries take 192 MB, or 512 MB)
+#ifndef MCUMAX_HASH_TABLE_SIZE
+#define MCUMAX_HASH_TABLE_SIZE (1 << 24)
+#endif
+
+// Two-tier hashing: a small, cache-resident near table holds the entries of
+// shallow iterations, which dominate the traffic; deeper ones go to the main
+// table. Entries, and the deepest iteration stored in the near table.
+#ifndef MCUMAX_HASH_NEAR_SIZE
+#define MCUMAX_HASH_NEAR_SIZE (1 << 14)
+#endif
+#ifndef MCUMAX_HASH_NEAR_DEPTH
+#define MCUMAX_HASH_NEAR_DEPTH 3
+#endif
+
+// Search parameters (runtime values with MCUMAX_TUNING_ENABLED, see
+// mcumax_set_params()). Material gates compare against non_pawn_material,
+// which grows as pieces are traded off.
+#ifndef MCUMAX_NULL_MOVE_REDUCTION
+#define MCUMAX_NULL_MOVE_REDUCTION 3
+#endif
+#ifndef MCUMAX_NULL_MOVE_MATERIAL
+#define MCUMAX_NULL_MOVE_MATERIAL 35
+#endif
+#ifndef MCUMAX_REDUCTION_DEPTH
+#define MCUMAX_REDUCTION_DEPTH 5
+#endif
+#ifndef MCUMAX_CHECK_EXTENSION_MATERIAL
+#define MCUMAX_CHECK_EXTENSION_MATERIAL 30
+#endif
+#ifndef MCUMAX_KING_FREEZE_MATERIAL
+#define MCUMAX_KING_FREEZE_MATERIAL 30
+#endif
+#ifndef MCUMAX_KING_FREEZE_PENALTY
+#define MCUMAX_KING_FREEZE_PENALTY 20
+#endif
+
+// ProbCut: minimum iteration depth, search reduction and beta margin
+#ifndef MCUMAX_PROBCUT_DEPTH
+#define MCUMAX_PROBCUT_DEPTH 8
+#endif
+#ifndef MCUMAX_PROBCUT_REDUCTION
+#define MCUMAX_PROBCUT_REDUCTION 4
+#endif
+#ifndef MCUMAX_PROBCUT_MARGIN
+#define MCUMAX_PROBCUT_MARGIN 100
+#endif
+
+// Mobility: score per pseudo-legal move of the side to move
+#ifndef MCUMAX_MOBILITY_WEIGHT
+#define MCUMAX_MOBILITY_WEIGHT 2
+#endif
+
+// King safety: attack count above which the danger table saturates
+#ifndef MCUMAX_KING_ATTACKS_MAX
+#define MCUMAX_KING_ATTACKS_MAX 15
+#endif
+
+// Lazy evaluation: material margin outside the window that skips the
+// positional terms
+#ifndef MCUMAX_LAZY_EVAL_MARGIN
+#define MCUMAX_LAZY_EVAL_MARGIN 250
+#endif
+
+// Valid moves checked by mcumax_search_best_move_bounded() (at most 218
+// in a legal position)
+#ifndef MCUMAX_VALID_MOVES_MAX
+#define MCUMAX_VALID_MOVES_MAX 256
+#endif
+
+// Parallel search: thread limit and minimum root iteration depth for splitting
+#ifndef MCUMAX_PARALLEL_THREADS_MAX
+#define MCUMAX_PARALLEL_THREADS_MAX 64
+#endif
+#ifndef MCUMAX_PARALLEL_DEPTH
+#define MCUMAX_PARALLEL_DEPTH 4
+#endif
+
+// Parallel search: deferred root moves (a copy of the engine state each);
+// root moves beyond them are searched by the root thread
+#ifndef MCUMAX_PARALLEL_JOBS_MAX
+#define MCUMAX_PARALLEL_JOBS_MAX 64
+#endif
+
+#if defined(MCUMAX_HASH_NEAR_ENABLED) && !defined(MCUMAX_HASHING_ENABLED)
+#error "MCUMAX_HASH_NEAR_ENABLED requires MCUMAX_HASHING_ENABLED"
+#endif
+
+#if defined(MCUMAX_HASH_STATS_ENABLED) && !defined(MCUMAX_HASHING_ENABLED)
+#error "MCUMAX_HASH_STATS_ENABLED requires MCUMAX_HASHING_ENABLED"
+#endif
+
+#if defined(MCUMAX_HASH_VERIFY_ENABLED) && !defined(MCUMAX_HASHING_ENABLED)
+#error "MCUMAX_HASH_VERIFY_ENABLED requires MCUMAX_HASHING_ENABLED"
+#endif
+
+#if defined(MCUMAX_REPETITION_ENABLED) && !defined(MCUMAX_HASHING_ENABLED)
+#error "MCUMAX_REPETITION_ENABLED requires MCUMAX_HASHING_ENABLED"
+#endif
+
+#if defined(MCUMAX_PV_ENABLED) && \
+    (defined(MCUMAX_HASHING_ENABLED) || defined(MCUMAX_PARALLEL_ENABLED))
+#error "MCUMAX_PV_ENABLED replaces the hash table's move hints and excludes parallel search"
+#endif
+
+#if defined(MCUMAX_PARALLEL_ENABLED) && defined(MCUMAX_HASHING_ENABLED)
+#error "MCUMAX_PARALLEL_ENABLED requires a per-thread hash table, disable MCUMAX_HASHING_ENABLED"
+#endif
+
+#if defined(MCUMAX_LAZY_EVAL_ENABLED) &&   \
+    !(defined(MCUMAX_MOBILITY_ENABLED) || \
+      defined(MCUMAX_KING_SAFETY_ENABLED))
+#error "MCUMAX_LAZY_EVAL_ENABLED requires MCUMAX_MOBILITY_ENABLED or MCUMAX_KING_SAFETY_ENABLED"
+#endif
+
+#if defined(MCUMAX_MINIMAL_ENABLED) &&  \
+    (defined(MCUMAX_HASHING_ENABLED) || \
+     defined(MCUMAX_PROBCUT_ENABLED) || \
+     defined(MCUMAX_PARALLEL_ENABLED) || \
+     defined(MCUMAX_SPECIALIZED_SEARCH_ENABLED))
+#error "MCUMAX_MINIMAL_ENABLED excludes hashing, ProbCut, parallel and specialized search"
+#endif
+
+// Specialized search: the search body is inlined into a root and an
+// interior node function, the latter without any mode checks (about 30%
+// more flash, less stack per ply); otherwise a single copy is kept
+#if !defined(MCUMAX_SPECIALIZED_SEARCH_ENABLED)
+#define MCUMAX_SEARCH_INLINE
+#elif defined(__GNUC__)
+#define MCUMAX_SEARCH_INLINE inline __attribute__((always_inline))
+#else
+#define MCUMAX_SEARCH_INLINE inline
+#endif
 
 // Constants
 #define MCUMAX_BOARD_MASK 0x88
@@ -35,7 +193,28 @@ enum mcumax_mode
     MCUMAX_PLAY_MOVE,
 };
 
-mcumax_struct mcumax;
+MCUMAX_THREAD_LOCAL mcumax_struct mcumax;
+
+#ifdef MCUMAX_TUNING_ENABLED
+static MCUMAX_THREAD_LOCAL mcumax_params mcumax_tuning = {
+    MCUMAX_NULL_MOVE_REDUCTION,
+    MCUMAX_NULL_MOVE_MATERIAL,
+    MCUMAX_REDUCTION_DEPTH,
+    MCUMAX_CHECK_EXTENSION_MATERIAL,
+    MCUMAX_KING_FREEZE_MATERIAL,
+    MCUMAX_KING_FREEZE_PENALTY,
+#ifdef MCUMAX_PROBCUT_ENABLED
+    MCUMAX_PROBCUT_MARGIN,
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    MCUMAX_LAZY_EVAL_MARGIN,
+#endif
+};
+
+#define MCUMAX_PARAM(NAME, DEFAULT) (mcumax_tuning.NAME)
+#else
+#define MCUMAX_PARAM(NAME, DEFAULT) (DEFAULT)
+#endif
 
 static const int8_t mcumax_capture_values[] = {
     0, 2, 2, 7, -1, 8, 12, 23};
@@ -64,17 +243,35 @@ static const int8_t mcumax_board_setup[] = {
     MCUMAX_ROOK,
 };
 
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+// Danger to a king by moves into its zone (king square and neighbours)
+static const uint8_t mcumax_king_danger[MCUMAX_KING_ATTACKS_MAX + 1] = {
+    0, 0, 2, 5, 9, 14, 20, 27, 35, 44, 54, 65, 77, 90, 104, 119};
+
+#define MCUMAX_KING_DANGER(A) \
+    mcumax_king_danger[(A) < MCUMAX_KING_ATTACKS_MAX ? (A) : MCUMAX_KING_ATTACKS_MAX]
+
+// Square offset (0x88) within the king zone
+static inline bool mcumax_is_king_zone(uint8_t offset)
+{
+    offset += 0x11;
+
+    return !(offset & 0xcc) &&
+           ((offset & 0x03) != 0x03) &&
+           ((offset & 0x30) != 0x30);
+}
+#endif
+
 #ifdef MCUMAX_HASHING_ENABLED
 
 #define MCUMAX_HASH_SCRAMBLE_TABLE_SIZE 1035
-#define MCUMAX_HASH_TABLE_SIZE (1 << 24)
 
 #define HashScramble(A, B)                \
     *(uint32_t *)(mcumax_scramble_table + \
                   A + (B & 8) + MCUMAX_SQUARE_INVALID * (B & 0b111))
-#define Hash(A)                                                      \
-    HashScramble(step_square_to + A, mcumax.board[step_square_to]) - \
-        HashScramble(scan_square_from + A, scan_piece) -             \
+#define Hash(A)                                            \
+    HashScramble(square_to + A, mcumax.board[square_to]) - \
+        HashScramble(square_from + A, scan_piece) -        \
         HashScramble(capture_square + A, capture_piece)
 
 static uint8_t mcumax_scramble_table[MCUMAX_HASH_SCRAMBLE_TABLE_SIZE]; /* hash translation table */
@@ -86,34 +283,258 @@ struct HashEntry
     uint8_t square_from;
     uint8_t square_to;
     uint8_t depth;
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    // Shadow keys of the pieces and of the full position, for collision
+    // diagnostics only
+    uint64_t piece_key;
+    uint64_t position_key;
+#endif
 };
 
 static struct HashEntry mcumax_hash_table[MCUMAX_HASH_TABLE_SIZE];
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+static struct HashEntry mcumax_hash_near_table[MCUMAX_HASH_NEAR_SIZE];
+#endif
+
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+#define MCUMAX_FNV_OFFSET 0xcbf29ce484222325ULL
+#define MCUMAX_FNV_PRIME 0x100000001b3ULL
+
+// 64-bit FNV-1a keys, independent of the scramble table: of the pieces
+// (what the scramble keys cover), and of the whole position, which adds the
+// moved flags, the side to move and the e.p. square
+static uint64_t mcumax_get_position_key(uint8_t en_passant_square, uint64_t *piece_key)
+{
+    uint64_t key = MCUMAX_FNV_OFFSET;
+
+    *piece_key = MCUMAX_FNV_OFFSET;
+
+    for (uint8_t square = 0; square < 0x80; square = (square + 9) & ~0x08)
+    {
+        *piece_key = (*piece_key ^ (mcumax.board[square] & 0x1f)) * MCUMAX_FNV_PRIME;
+        key = (key ^ mcumax.board[square]) * MCUMAX_FNV_PRIME;
+    }
+    key = (key ^ mcumax.current_side) * MCUMAX_FNV_PRIME;
+
+    return (key ^ en_passant_square) * MCUMAX_FNV_PRIME;
+}
+#endif
+
+#ifdef MCUMAX_REPETITION_ENABLED
+// Game history kept when a game move is played; the rest is search path
+#define MCUMAX_HISTORY_GAME_MAX (MCUMAX_HISTORY_SIZE / 2)
+
+static void mcumax_init_cuckoo(void);
+static bool mcumax_is_repetition_upcoming(void);
+#endif
 
 #endif
 
 typedef bool (*mcumax_move_callback)(mcumax_move move);
 
+#ifndef MCUMAX_SPECIALIZED_SEARCH_ENABLED
+static int32_t mcumax_search_node(int32_t alpha,
+                                  int32_t beta,
+                                  int32_t score,
+                                  uint8_t en_passant_square,
+                                  uint8_t depth,
+                                  enum mcumax_mode mode);
+
+#define mcumax_search(alpha, beta, score, en_passant_square, depth) \
+    mcumax_search_node(alpha, beta, score, en_passant_square, depth, MCUMAX_INTERNAL_NODE)
+#define mcumax_search_root mcumax_search_node
+#else
 static int32_t mcumax_search(int32_t alpha,
                              int32_t beta,
                              int32_t score,
                              uint8_t en_passant_square,
-                             uint8_t depth,
-                             enum mcumax_mode mode);
+                             uint8_t depth);
+#endif
+
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+// Root: an iteration that would overrun the node limit is searched in vain
+// (the best move of the last complete iteration is played), so predict its
+// nodes from the effective branching factor of the last two
+static bool mcumax_is_iteration_affordable(void)
+{
+    uint32_t last_count = mcumax.iteration_node_counts[1];
+    uint32_t previous_count = mcumax.iteration_node_counts[0];
+
+    if (!previous_count)
+        return true;
+
+    uint64_t predicted_count = (uint64_t)last_count * last_count / previous_count;
+
+    if (mcumax.node_count + predicted_count <= mcumax.node_max)
+        return true;
+
+    mcumax.iteration_skip_count++;
+    mcumax.iteration_skip_nodes += (predicted_count < UINT32_MAX - mcumax.iteration_skip_nodes)
+                                       ? (uint32_t)predicted_count
+                                       : UINT32_MAX - mcumax.iteration_skip_nodes;
+
+    return false;
+}
+#endif
+
+#ifdef MCUMAX_PARALLEL_ENABLED
+
+// Young brother of the root, deferred until the eldest brother is searched
+struct mcumax_job
+{
+    mcumax_struct state;
+    uint8_t square_from;
+    uint8_t square_to;
+    uint8_t castling_skip_square;
+    uint8_t step_depth;
+    uint8_t iter_depth;
+    int32_t alpha;
+    int32_t beta;
+    int32_t step_alpha;
+    int32_t step_score;
+    int32_t score;
+    uint32_t node_count;
+};
+
+// The thread count is per engine; the job pool is shared by the process,
+// so only one engine at a time may run a parallel search
+static MCUMAX_THREAD_LOCAL uint32_t mcumax_threads_num;
+
+static struct mcumax_job mcumax_jobs[MCUMAX_PARALLEL_JOBS_MAX];
+static uint32_t mcumax_jobs_num;
+static uint32_t mcumax_jobs_next;
+static uint32_t mcumax_jobs_stop;
+#ifdef MCUMAX_TUNING_ENABLED
+static mcumax_params mcumax_jobs_params;
+#endif
+
+static MCUMAX_THREAD_LOCAL bool mcumax_in_job;
+
+// Searches a deferred root move on the calling thread's engine state
+static void mcumax_search_job(struct mcumax_job *job, bool is_root_thread)
+{
+    uint8_t step_depth = job->step_depth;
+    int32_t step_score_new;
+
+    mcumax = job->state;
+    if (!is_root_thread)
+        mcumax.user_callback = NULL;
+    mcumax.node_count = 0;
+
+    // Futility, recursive evaluation of reply
+    do
+    {
+        // Change side
+        mcumax.current_side ^= 0x18;
+
+#ifdef MCUMAX_MOBILITY_ENABLED
+        mcumax.mobility = job->state.mobility;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+        mcumax.king_attacks = job->state.king_attacks;
+#endif
+
+        step_score_new = ((step_depth > 2) ||
+                          (job->step_score > job->step_alpha))
+                             ? -mcumax_search(-job->beta,
+                                              -job->step_alpha,
+                                              -job->step_score,
+                                              job->castling_skip_square,
+                                              step_depth)
+                             : job->step_score;
+
+        // Change side
+        mcumax.current_side ^= 0x18;
+    } while ((step_score_new > job->alpha) &&
+             (++step_depth < job->iter_depth));
+
+    job->score = step_score_new;
+    job->node_count = mcumax.node_count;
+}
+
+// The root thread keeps the user callback; a non-NULL arg marks it
+static void mcumax_run_job_worker(void *arg)
+{
+    uint32_t job_index;
+
+    mcumax_in_job = true;
+#ifdef MCUMAX_TUNING_ENABLED
+    mcumax_tuning = mcumax_jobs_params;
+#endif
+
+    while (!mcumax_atomic_load(&mcumax_jobs_stop) &&
+           ((job_index = mcumax_atomic_fetch_add(&mcumax_jobs_next, 1)) <
+            mcumax_jobs_num))
+        mcumax_search_job(&mcumax_jobs[job_index], arg != NULL);
+
+    mcumax_in_job = false;
+}
+
+// Searches all deferred jobs; results only depend on the jobs, not on scheduling
+static void mcumax_run_jobs(void)
+{
+    mcumax_thread threads[MCUMAX_PARALLEL_THREADS_MAX];
+    uint32_t threads_num = 0;
+
+    mcumax_struct root_state = mcumax;
+
+    mcumax_jobs_next = 0;
+#ifdef MCUMAX_TUNING_ENABLED
+    mcumax_jobs_params = mcumax_tuning;
+#endif
+    mcumax_atomic_store(&mcumax_jobs_stop, false);
+
+    while ((threads_num + 1 < mcumax_threads_num) &&
+           mcumax_thread_create(&threads[threads_num], mcumax_run_job_worker, NULL))
+        threads_num++;
+
+    mcumax_run_job_worker(&root_state);
+
+    for (uint32_t i = 0; i < threads_num; i++)
+        mcumax_thread_join(&threads[i]);
+
+    mcumax = root_state;
+    mcumax.stop_search = mcumax_atomic_load(&mcumax_jobs_stop);
+}
+
+#endif
 
 // Recursive minimax search
 // (alpha,beta)=window, score=current evaluation score, en_passant_square=e.p. sqr.
-// depth=depth, in_root=in_root; returns score
-static int32_t mcumax_search(int32_t alpha,
-                             int32_t beta,
-                             int32_t score,
-                             uint8_t en_passant_square,
-                             uint8_t depth,
-                             enum mcumax_mode mode)
+// depth=depth, mode=node type; returns score
+// With MCUMAX_SPECIALIZED_SEARCH_ENABLED, inlined into one function per node
+// type, so interior nodes get a copy with the mode folded away
+static MCUMAX_SEARCH_INLINE int32_t mcumax_search_node(int32_t alpha,
+                                                       int32_t beta,
+                                                       int32_t score,
+                                                       uint8_t en_passant_square,
+                                                       uint8_t depth,
+                                                       enum mcumax_mode mode)
 {
     if (mcumax.user_callback)
         mcumax.user_callback(mcumax.user_data);
 
+#ifdef MCUMAX_PARALLEL_ENABLED
+    // Share stop requests between the threads searching deferred root moves
+    if (mcumax_in_job)
+    {
+        if (mcumax.stop_search)
+            mcumax_atomic_store(&mcumax_jobs_stop, true);
+        else if (mcumax_atomic_load(&mcumax_jobs_stop))
+            mcumax.stop_search = true;
+    }
+#endif
+
+    // Playing or listing moves only needs legality, not scores
+    bool legality_only = (mode == MCUMAX_PLAY_MOVE) ||
+                         (mode == MCUMAX_SEARCH_VALID_MOVES);
+
+#ifdef MCUMAX_PROBCUT_ENABLED
+    // ProbCut probe of the parent: gated captures only, no null move
+    bool probcut_node = mcumax.probcut_node;
+    mcumax.probcut_node = false;
+#endif
+
     uint8_t iter_depth;
     int32_t iter_score;
     uint8_t iter_square_from;
@@ -124,6 +545,18 @@ static int32_t mcumax_search(int32_t alpha,
     int32_t hash_key2;
 #endif
 
+#ifdef MCUMAX_REPETITION_ENABLED
+    uint8_t history_num = mcumax.history_num;
+    uint8_t reversible_plies = mcumax.reversible_plies;
+#endif
+
+#ifdef MCUMAX_PV_ENABLED
+    uint8_t ply = mcumax.ply;
+    uint8_t pv_follow = mcumax.pv_follow;
+    uint8_t pv_square_from = MCUMAX_SQUARE_INVALID;
+    uint8_t pv_square_to = MCUMAX_SQUARE_INVALID;
+#endif
+
     uint8_t square_start;
 
     uint8_t square_from;
@@ -150,16 +583,92 @@ static int32_t mcumax_search(int32_t alpha,
     int32_t step_score;
     int32_t step_score_new;
 
+#ifdef MCUMAX_PROBCUT_ENABLED
+    int32_t probcut_beta;
+#endif
+
+#ifdef MCUMAX_MOBILITY_ENABLED
+    // Until counted, mobility balances the opponent's
+    uint8_t opponent_mobility = mcumax.mobility;
+    uint8_t mobility = opponent_mobility;
+#endif
+
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+    // Attacks on the opponent's king zone; ours were counted by the parent
+    uint8_t opponent_king_attacks = mcumax.king_attacks;
+    uint8_t king_attacks = opponent_king_attacks;
+    uint8_t opponent_king_square = mcumax.king_squares[(mcumax.current_side >> 4) ^ 1];
+#endif
+
+#if defined(MCUMAX_MOBILITY_ENABLED) || defined(MCUMAX_KING_SAFETY_ENABLED)
+    bool eval_full;
+#endif
+
+#ifdef MCUMAX_PARALLEL_ENABLED
+    bool split;
+    bool eldest_searched;
+#endif
+
+#ifdef MCUMAX_REPETITION_ENABLED
+    // Upcoming repetition: a reversible move returns to an earlier position,
+    // so the side to move can hold at least a draw (legality replies excluded)
+    if ((mode == MCUMAX_INTERNAL_NODE) &&
+        (beta <= 0) &&
+        (beta > -MCUMAX_SCORE_MAX / 2) &&
+        mcumax_is_repetition_upcoming())
+    {
+        mcumax.repetition_cut_count++;
+
+        return 0;
+    }
+#endif
+
     // Adj. window: delay bonus
     alpha -= alpha < score;
     beta -= beta <= score;
 
 #ifdef MCUMAX_HASHING_ENABLED
     // Lookup pos. in hash table
+    uint32_t hash_index = mcumax.hash_key + mcumax.current_side * en_passant_square;
     struct HashEntry *hash_entry = mcumax_hash_table +
-                                   ((mcumax.hash_key +
-                                     mcumax.current_side * en_passant_square) &
-                                    MCUMAX_HASH_TABLE_SIZE - 1);
+                                   (hash_index & (MCUMAX_HASH_TABLE_SIZE - 1));
+
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+    // Near table first: a hit there saves the main table's cache miss
+    struct HashEntry *hash_main_entry = hash_entry;
+    struct HashEntry *hash_near_entry = mcumax_hash_near_table +
+                                        (hash_index & (MCUMAX_HASH_NEAR_SIZE - 1));
+
+    if (hash_near_entry->key2 == mcumax.hash_key2)
+    {
+        hash_entry = hash_near_entry;
+#ifdef MCUMAX_HASH_STATS_ENABLED
+        mcumax.hash_near_hit_count++;
+#endif
+    }
+#endif
+
+#ifdef MCUMAX_HASH_STATS_ENABLED
+    mcumax.hash_probe_count++;
+    if (hash_entry->key2 == mcumax.hash_key2)
+        mcumax.hash_hit_count++;
+#endif
+
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    // Shadow mode: classify hits without changing the search
+    uint64_t piece_key;
+    uint64_t position_key = mcumax_get_position_key(en_passant_square, &piece_key);
+
+    if (hash_entry->key2 == mcumax.hash_key2)
+    {
+        if (hash_entry->position_key == position_key)
+            mcumax.hash_verified_count++;
+        else if (hash_entry->piece_key == piece_key)
+            mcumax.hash_alias_count++;
+        else
+            mcumax.hash_collision_count++;
+    }
+#endif
 
     iter_depth = hash_entry->depth;
     iter_score = hash_entry->score;
@@ -169,6 +678,9 @@ static int32_t mcumax_search(int32_t alpha,
     // Resume at stored depth
     if ((hash_entry->key2 != mcumax.hash_key2) ||
         (mode != MCUMAX_INTERNAL_NODE) || // Miss: other pos. or empty
+#ifdef MCUMAX_PROBCUT_ENABLED
+        probcut_node ||
+#endif
         !(((iter_score <= alpha) ||
            (iter_square_from & 0x8)) &&
           ((iter_score >= beta) ||
@@ -178,6 +690,10 @@ static int32_t mcumax_search(int32_t alpha,
         iter_depth =
             iter_square_to = 0;
     }
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    else if (hash_entry->piece_key != piece_key)
+        mcumax.hash_collision_used_count++;
+#endif
 
     // Start at best-move hint
     iter_square_from &= ~MCUMAX_BOARD_MASK;
@@ -191,15 +707,50 @@ static int32_t mcumax_search(int32_t alpha,
                 iter_square_to = 0;
 #endif
 
+#ifdef MCUMAX_PV_ENABLED
+    if (ply < MCUMAX_PV_LENGTH)
+        mcumax.pv_lines_num[ply] = 0;
+
+    // On the line the last search predicted: start at its move
+    if ((pv_follow == ply) &&
+        (mcumax.pv_played + ply < mcumax.pv_num) &&
+        !legality_only)
+    {
+        iter_square_from = mcumax.pv[mcumax.pv_played + ply].from;
+        iter_square_to = mcumax.pv[mcumax.pv_played + ply].to;
+
+        pv_square_from = iter_square_from;
+        pv_square_to = iter_square_to & ~MCUMAX_SQUARE_INVALID;
+
+        // Root: the last search already covered the shallower iterations,
+        // so start at the depth it reached here
+        if ((mode == MCUMAX_SEARCH_BEST_MOVE) &&
+            (mcumax.pv_depth > mcumax.pv_played + 1))
+        {
+            iter_depth = mcumax.pv_depth - mcumax.pv_played - 1;
+            if (iter_depth >= mcumax.depth_max)
+                iter_depth = mcumax.depth_max - 1;
+        }
+    }
+#endif
+
+    // Legality: single iteration with all moves
+    if (legality_only)
+        iter_depth = 2;
+
     // Min depth = 2 iterative deepening loop
     // root: deepen upto time
     // time's up: go do best
     while ((iter_depth++ < depth) ||
            (iter_depth < 3) ||
-           ((mode != MCUMAX_INTERNAL_NODE) &&
+           ((mode == MCUMAX_SEARCH_BEST_MOVE) &&
             (mcumax.square_from == MCUMAX_SQUARE_INVALID) &&
             (((mcumax.node_count < mcumax.node_max) &&
-              (iter_depth <= mcumax.depth_max)) ||
+              (iter_depth <= mcumax.depth_max)
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+              && mcumax_is_iteration_affordable()
+#endif
+                  ) ||
              (mcumax.square_from = iter_square_from,
               mcumax.square_to = iter_square_to & ~MCUMAX_BOARD_MASK,
               iter_depth = 3))))
@@ -207,6 +758,12 @@ static int32_t mcumax_search(int32_t alpha,
         if (mcumax.stop_search)
             break;
 
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+        if ((mode == MCUMAX_SEARCH_BEST_MOVE) &&
+            (mcumax.square_from == MCUMAX_SQUARE_INVALID))
+            mcumax.iteration_start_count = mcumax.node_count;
+#endif
+
         // Start scan at previous best
         square_from =
             square_start = (mode != MCUMAX_SEARCH_VALID_MOVES)
@@ -219,30 +776,149 @@ static int32_t mcumax_search(int32_t alpha,
         // Change side
         mcumax.current_side ^= 0x18;
 
+#ifdef MCUMAX_MOBILITY_ENABLED
+        mcumax.mobility = mobility;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+        mcumax.king_attacks = king_attacks;
+#endif
+
+#ifdef MCUMAX_REPETITION_ENABLED
+        // No repetitions across the null move
+        mcumax.reversible_plies = 0;
+#endif
+
+#ifdef MCUMAX_PV_ENABLED
+        mcumax.ply = ply + 1;
+#endif
+
         // Search null move
-        null_move_score = (iter_depth > 2) && (beta != -MCUMAX_SCORE_MAX)
+        null_move_score = (iter_depth > 2) &&
+                                  (beta != -MCUMAX_SCORE_MAX) &&
+                                  !legality_only
+#ifdef MCUMAX_PROBCUT_ENABLED
+                                  && !probcut_node
+#endif
                               ? mcumax_search(-beta,
                                               1 - beta,
                                               -score,
                                               MCUMAX_SQUARE_INVALID,
-                                              iter_depth - 3,
-                                              MCUMAX_INTERNAL_NODE)
+                                              (iter_depth > MCUMAX_PARAM(null_move_reduction,
+                                                                         MCUMAX_NULL_MOVE_REDUCTION))
+                                                  ? iter_depth - MCUMAX_PARAM(null_move_reduction,
+                                                                              MCUMAX_NULL_MOVE_REDUCTION)
+                                                  : 0)
                               : MCUMAX_SCORE_MAX;
 
+#ifdef MCUMAX_REPETITION_ENABLED
+        mcumax.reversible_plies = reversible_plies;
+#endif
+#ifdef MCUMAX_PV_ENABLED
+        mcumax.ply = ply;
+#endif
+
         // Change side
         mcumax.current_side ^= 0x18;
 
         // Prune if > beta unconsidered:static eval
         iter_score = (-null_move_score < beta) ||
-                             (mcumax.non_pawn_material > 35)
+                             (mcumax.non_pawn_material > MCUMAX_PARAM(null_move_material,
+                                                                      MCUMAX_NULL_MOVE_MATERIAL))
                          ? (iter_depth - 2)
                                ? -MCUMAX_SCORE_MAX
                                : score
+#ifdef MCUMAX_MOBILITY_ENABLED
+                                     + MCUMAX_MOBILITY_WEIGHT * (mobility - opponent_mobility)
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+                                     + ((mcumax.non_pawn_material > 30)
+                                            ? 0
+                                            : MCUMAX_KING_DANGER(king_attacks) -
+                                                  MCUMAX_KING_DANGER(opponent_king_attacks))
+#endif
                          : -null_move_score;
 
+#if defined(MCUMAX_MOBILITY_ENABLED) || defined(MCUMAX_KING_SAFETY_ENABLED)
+        // Positional terms: counted while the MVV/LVA pass walks all moves
+        eval_full = (iter_depth == 1);
+
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+        // Lazy evaluation: material alone decides far outside the window
+        if (eval_full)
+        {
+            eval_full = (score + MCUMAX_PARAM(lazy_eval_margin, MCUMAX_LAZY_EVAL_MARGIN) > alpha) &&
+                        (score - MCUMAX_PARAM(lazy_eval_margin, MCUMAX_LAZY_EVAL_MARGIN) < beta);
+
+            if (eval_full)
+                mcumax.eval_full_count++;
+            else
+                mcumax.eval_lazy_count++;
+        }
+#endif
+#endif
+
+#ifdef MCUMAX_MOBILITY_ENABLED
+        if (eval_full)
+            mobility = 0;
+#endif
+
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+        if (eval_full)
+            king_attacks = 0;
+#endif
+
         // Node count (for timing)
         mcumax.node_count++;
 
+#ifdef MCUMAX_PARALLEL_ENABLED
+        // Split root after first move (young brothers wait)
+        split = (mode == MCUMAX_SEARCH_BEST_MOVE) &&
+                mcumax_threads_num &&
+                (mcumax.square_from == MCUMAX_SQUARE_INVALID) &&
+                (iter_depth >= MCUMAX_PARALLEL_DEPTH);
+        eldest_searched = false;
+
+        if (split)
+            mcumax_jobs_num = 0;
+#endif
+
+#ifdef MCUMAX_PROBCUT_ENABLED
+        // ProbCut: reduced search of the good captures against raised beta
+        probcut_beta = beta + MCUMAX_PARAM(probcut_margin, MCUMAX_PROBCUT_MARGIN);
+
+        if ((mode == MCUMAX_INTERNAL_NODE) &&
+            (iter_depth >= MCUMAX_PROBCUT_DEPTH) &&
+            (iter_score < beta) &&
+            (null_move_score != MCUMAX_SCORE_MAX) && // Not in check
+            (probcut_beta < MCUMAX_SCORE_MAX / 2) &&
+            (beta > -MCUMAX_SCORE_MAX / 2))
+        {
+            mcumax.probcut_try_count++;
+
+#ifdef MCUMAX_MOBILITY_ENABLED
+            mcumax.mobility = opponent_mobility;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+            mcumax.king_attacks = opponent_king_attacks;
+#endif
+
+            mcumax.probcut_node = true;
+
+            if (mcumax_search(probcut_beta - 1,
+                              probcut_beta,
+                              score,
+                              en_passant_square,
+                              iter_depth - MCUMAX_PROBCUT_REDUCTION) >= probcut_beta)
+            {
+                mcumax.probcut_cut_count++;
+
+                iter_score = beta;
+
+                goto cutoff;
+            }
+        }
+#endif
+
         do
         {
             // Scan board looking for
@@ -289,7 +965,10 @@ static int32_t mcumax_search(int32_t alpha,
                             mcumax.board[en_passant_square] &&
                             ((square_to - en_passant_square) < 2) &&
                             ((en_passant_square - square_to) < 2))
+                        {
                             iter_score = MCUMAX_SCORE_MAX;
+                            iter_depth = MCUMAX_DEPTH_MAX - 1;
+                        }
 
                         // Shift capture square if en-passant
                         if ((scan_piece_type < 3) &&
@@ -304,6 +983,14 @@ static int32_t mcumax_search(int32_t alpha,
                              !((square_to - square_from) & 0b111) - !capture_piece))
                             break;
 
+#ifdef MCUMAX_MOBILITY_ENABLED
+                        mobility += eval_full;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+                        king_attacks += eval_full &&
+                                        mcumax_is_king_zone(square_to - opponent_king_square);
+#endif
+
                         // Value of captured piece
                         capture_piece_value = 37 * mcumax_capture_values[capture_piece & 0b111] +
                                               (capture_piece & 0xc0);
@@ -320,13 +1007,32 @@ static int32_t mcumax_search(int32_t alpha,
                             (iter_depth > 1))
                             goto cutoff;
 
+#ifdef MCUMAX_PV_ENABLED
+                        // No reply line unless searched
+                        if (ply + 1 < MCUMAX_PV_LENGTH)
+                            mcumax.pv_lines_num[ply + 1] = 0;
+#endif
+
                         // MVV/LVA scoring if depth == 1
                         step_score = (iter_depth != 1)
                                          ? score
                                          : capture_piece_value - scan_piece_type;
 
-                        // All captures if depth == 2
-                        if ((iter_depth - !capture_piece) > 1)
+                        // All captures if depth == 2, only the move to play
+                        if (((iter_depth - !capture_piece) > 1) &&
+                            ((mode != MCUMAX_PLAY_MOVE) ||
+                             ((square_from == mcumax.square_from) &&
+                              (square_to == mcumax.square_to)))
+#ifdef MCUMAX_PROBCUT_ENABLED
+                            // ProbCut probe: captures of at least the
+                            // attacker's value (MVV/LVA) that can reach beta
+                            && (!probcut_node ||
+                                (capture_piece &&
+                                 (capture_piece_value >=
+                                  37 * mcumax_capture_values[scan_piece_type]) &&
+                                 (score + capture_piece_value >= beta)))
+#endif
+                        )
                         {
                             // Center positional score
                             step_score = (scan_piece_type < 6)
@@ -341,6 +1047,11 @@ static int32_t mcumax_search(int32_t alpha,
                             // Do move, set non-virgin
                             mcumax.board[square_to] = scan_piece | MCUMAX_PIECE_MOVED;
 
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+                            if (scan_piece_type == 4)
+                                mcumax.king_squares[mcumax.current_side >> 4] = square_to;
+#endif
+
                             // Castling: put rook & score
                             if (!(castling_rook_square & MCUMAX_BOARD_MASK))
                             {
@@ -350,9 +1061,10 @@ static int32_t mcumax_search(int32_t alpha,
 
                             // Freeze king in mid-game
                             step_score -= ((scan_piece_type != 4) ||
-                                           (mcumax.non_pawn_material > 30))
+                                           (mcumax.non_pawn_material >
+                                            MCUMAX_PARAM(king_freeze_material, MCUMAX_KING_FREEZE_MATERIAL)))
                                               ? 0
-                                              : 20;
+                                              : MCUMAX_PARAM(king_freeze_penalty, MCUMAX_KING_FREEZE_PENALTY);
 
                             // Pawns
                             if (scan_piece_type < 3)
@@ -385,42 +1097,116 @@ static int32_t mcumax_search(int32_t alpha,
                             mcumax.hash_key2 += Hash(8) + castling_rook_square - MCUMAX_SQUARE_INVALID;
 #endif
 
+#ifdef MCUMAX_REPETITION_ENABLED
+                            // Captures, pawn moves and castling are irreversible
+                            if (history_num < MCUMAX_HISTORY_SIZE)
+                            {
+                                mcumax.key_history[history_num] = hash_key;
+                                mcumax.key2_history[history_num] = hash_key2;
+                                mcumax.history_num = history_num + 1;
+                                mcumax.reversible_plies =
+                                    (capture_piece ||
+                                     (scan_piece_type < 3) ||
+                                     !(castling_rook_square & MCUMAX_BOARD_MASK))
+                                        ? 0
+                                        : reversible_plies + 1;
+                            }
+                            else
+                                mcumax.reversible_plies = 0;
+#endif
+
                             // New score & alpha
                             step_score += score + capture_piece_value;
                             step_alpha = iter_score > alpha
                                              ? iter_score
                                              : alpha;
 
+                            // Legality: reply only has to find king capture
+                            if (legality_only)
+                                step_alpha = MCUMAX_SCORE_MAX - 1;
+
                             // New depth, reduce non-capture
                             step_depth = iter_depth - 1 -
-                                         ((iter_depth > 5) &&
+                                         ((iter_depth > MCUMAX_PARAM(reduction_depth,
+                                                                     MCUMAX_REDUCTION_DEPTH)) &&
                                           (scan_piece_type > 2) &&
                                           !capture_piece &&
                                           !replay_move);
 
                             // Extend 1 ply if in check
-                            if (!((mcumax.non_pawn_material > 30) ||
+                            if (!((mcumax.non_pawn_material >
+                                   MCUMAX_PARAM(check_extension_material,
+                                                MCUMAX_CHECK_EXTENSION_MATERIAL)) ||
+                                  legality_only ||
+#ifdef MCUMAX_PROBCUT_ENABLED
+                                  probcut_node ||
+#endif
                                   (null_move_score - MCUMAX_SCORE_MAX) ||
                                   (iter_depth < 3) ||
                                   (capture_piece &&
                                    (scan_piece_type != 4))))
                                 step_depth = iter_depth;
 
+#ifdef MCUMAX_PV_ENABLED
+                            // The reply follows the PV after its move
+                            mcumax.ply = ply + 1;
+                            if ((square_from == pv_square_from) &&
+                                (square_to == pv_square_to))
+                                mcumax.pv_follow = ply + 1;
+#endif
+
+#ifdef MCUMAX_PARALLEL_ENABLED
+                            if (split &&
+                                eldest_searched &&
+                                (mcumax_jobs_num < MCUMAX_PARALLEL_JOBS_MAX))
+                            {
+                                // Defer young brother with the eldest's window
+                                struct mcumax_job *job = &mcumax_jobs[mcumax_jobs_num++];
+
+#ifdef MCUMAX_MOBILITY_ENABLED
+                                mcumax.mobility = mobility;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+                                mcumax.king_attacks = king_attacks;
+#endif
+                                job->state = mcumax;
+                                job->square_from = square_from;
+                                job->square_to = square_to;
+                                job->castling_skip_square = castling_skip_square;
+                                job->step_depth = step_depth;
+                                job->iter_depth = iter_depth;
+                                job->alpha = alpha;
+                                job->beta = beta;
+                                job->step_alpha = step_alpha;
+                                job->step_score = step_score;
+                                job->score = -MCUMAX_SCORE_MAX;
+                                job->node_count = 0;
+
+                                step_score_new = -MCUMAX_SCORE_MAX;
+                            }
+                            else
+#endif
                             // Futility, recursive evaluation of reply
                             do
                             {
                                 // Change side
                                 mcumax.current_side ^= 0x18;
 
-                                step_score_new = ((mode == MCUMAX_SEARCH_VALID_MOVES) ||
+#ifdef MCUMAX_MOBILITY_ENABLED
+                                mcumax.mobility = mobility;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+                                mcumax.king_attacks = king_attacks;
+#endif
+
+                                step_score_new = (legality_only ||
                                                   (step_depth > 2) ||
                                                   (step_score > step_alpha))
                                                      ? -mcumax_search(-beta,
                                                                       -step_alpha,
                                                                       -step_score,
                                                                       castling_skip_square,
-                                                                      step_depth,
-                                                                      MCUMAX_INTERNAL_NODE)
+                                                                      step_depth)
                                                      : step_score;
 
                                 // Change side
@@ -428,6 +1214,15 @@ static int32_t mcumax_search(int32_t alpha,
                             } while ((step_score_new > alpha) &&
                                      (++step_depth < iter_depth));
 
+#ifdef MCUMAX_PV_ENABLED
+                            mcumax.ply = ply;
+                            mcumax.pv_follow = pv_follow;
+#endif
+
+#ifdef MCUMAX_PARALLEL_ENABLED
+                            eldest_searched = true;
+#endif
+
                             // No fail: re-search unreduced
                             step_score = step_score_new;
 
@@ -440,10 +1235,54 @@ static int32_t mcumax_search(int32_t alpha,
                                 mcumax.score = -score - capture_piece_value;
                                 mcumax.en_passant_square = castling_skip_square;
 
+                                mcumax.changed_squares[0] = square_from;
+                                mcumax.changed_squares[1] = square_to;
+                                mcumax.changed_squares[2] = capture_square;
+                                mcumax.changed_squares[3] = castling_rook_square;
+                                mcumax.changed_squares[4] = castling_rook_square & MCUMAX_BOARD_MASK
+                                                                ? MCUMAX_SQUARE_INVALID
+                                                                : castling_skip_square;
+
 #ifdef MCUMAX_HASHING_ENABLED
                                 // Lock game in hash as draw
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+                                hash_near_entry->key2 = hash_key2;
+                                hash_near_entry->depth = MCUMAX_DEPTH_MAX;
+                                hash_near_entry->score = 0;
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+                                hash_near_entry->piece_key = piece_key;
+                                hash_near_entry->position_key = position_key;
+#endif
+                                hash_entry = hash_main_entry;
+#endif
+                                hash_entry->key2 = hash_key2;
                                 hash_entry->depth = MCUMAX_DEPTH_MAX;
                                 hash_entry->score = 0;
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+                                hash_entry->piece_key = piece_key;
+                                hash_entry->position_key = position_key;
+#endif
+#endif
+
+#ifdef MCUMAX_REPETITION_ENABLED
+                                // Game history: positions before an
+                                // irreversible move cannot recur
+                                if (!mcumax.reversible_plies)
+                                    mcumax.history_num = 0;
+                                else if (mcumax.history_num > MCUMAX_HISTORY_GAME_MAX)
+                                {
+                                    uint8_t drop_num = mcumax.history_num - MCUMAX_HISTORY_GAME_MAX / 2;
+
+                                    mcumax.history_num -= drop_num;
+                                    memmove(mcumax.key_history,
+                                            mcumax.key_history + drop_num,
+                                            mcumax.history_num * sizeof(uint32_t));
+                                    memmove(mcumax.key2_history,
+                                            mcumax.key2_history + drop_num,
+                                            mcumax.history_num * sizeof(uint32_t));
+                                    if (mcumax.reversible_plies > mcumax.history_num)
+                                        mcumax.reversible_plies = mcumax.history_num;
+                                }
 #endif
 
                                 // Total captured material
@@ -460,6 +1299,10 @@ static int32_t mcumax_search(int32_t alpha,
                             mcumax.hash_key = hash_key;
                             mcumax.hash_key2 = hash_key2;
 #endif
+#ifdef MCUMAX_REPETITION_ENABLED
+                            mcumax.history_num = history_num;
+                            mcumax.reversible_plies = reversible_plies;
+#endif
 
                             // Undo move
                             mcumax.board[castling_rook_square] = mcumax.current_side + 6;
@@ -467,6 +1310,11 @@ static int32_t mcumax_search(int32_t alpha,
                             mcumax.board[square_from] = scan_piece;
                             mcumax.board[capture_square] = capture_piece;
 
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+                            if (scan_piece_type == 4)
+                                mcumax.king_squares[mcumax.current_side >> 4] = square_from;
+#endif
+
                             if ((mode == MCUMAX_SEARCH_BEST_MOVE) &&
                                 (step_score != -MCUMAX_SCORE_MAX) &&
                                 (square_from == mcumax.square_from) &&
@@ -498,6 +1346,20 @@ static int32_t mcumax_search(int32_t alpha,
                             iter_square_from = square_from;
                             iter_square_to = square_to |
                                              (castling_skip_square & MCUMAX_SQUARE_INVALID);
+
+#ifdef MCUMAX_PV_ENABLED
+                            // Move and reply line
+                            if (ply < MCUMAX_PV_LENGTH)
+                            {
+                                uint8_t pv_num = 1;
+
+                                mcumax.pv_lines[ply][0] = (mcumax_move){iter_square_from, iter_square_to};
+                                if (ply + 1 < MCUMAX_PV_LENGTH)
+                                    for (; pv_num <= mcumax.pv_lines_num[ply + 1]; pv_num++)
+                                        mcumax.pv_lines[ply][pv_num] = mcumax.pv_lines[ply + 1][pv_num - 1];
+                                mcumax.pv_lines_num[ply] = pv_num;
+                            }
+#endif
                         }
 
                         if (replay_move)
@@ -538,6 +1400,33 @@ static int32_t mcumax_search(int32_t alpha,
         } while ((square_from = ((square_from + 9) &
                                  ~MCUMAX_BOARD_MASK)) != square_start);
 
+#ifdef MCUMAX_PARALLEL_ENABLED
+        if (split && mcumax_jobs_num)
+        {
+            mcumax_run_jobs();
+
+            // Merge young brothers in generation order; after a stop, only
+            // the eldest brother's score is complete
+            for (uint32_t i = 0; i < mcumax_jobs_num; i++)
+            {
+                struct mcumax_job *job = &mcumax_jobs[i];
+
+                mcumax.node_count += job->node_count;
+
+                if (!mcumax.stop_search &&
+                    (job->score > iter_score))
+                {
+                    iter_score = job->score;
+                    iter_square_from = job->square_from;
+                    iter_square_to = job->square_to |
+                                     (job->castling_skip_square & MCUMAX_SQUARE_INVALID);
+                }
+            }
+
+            mcumax_jobs_num = 0;
+        }
+#endif
+
     cutoff:
         // Check test thru NM best loses king: (stale)mate
         if ((iter_score == -MCUMAX_SCORE_MAX) &&
@@ -545,8 +1434,27 @@ static int32_t mcumax_search(int32_t alpha,
             iter_score = 0;
 
 #ifdef MCUMAX_HASHING_ENABLED
-        // Protect game history
-        if (hash_entry->depth < MCUMAX_DEPTH_MAX)
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+        // Route by depth; a deeper result supersedes the near entry, which
+        // would otherwise shadow it
+        if (iter_depth <= MCUMAX_HASH_NEAR_DEPTH)
+            hash_entry = hash_near_entry;
+        else
+        {
+            hash_entry = hash_main_entry;
+
+            if ((hash_near_entry->key2 == mcumax.hash_key2) &&
+                (hash_near_entry->depth < MCUMAX_DEPTH_MAX))
+                hash_near_entry->key2 = ~mcumax.hash_key2;
+        }
+#endif
+
+        // Protect game history; a ProbCut probe only searched captures
+        if ((hash_entry->depth < MCUMAX_DEPTH_MAX)
+#ifdef MCUMAX_PROBCUT_ENABLED
+            && !probcut_node
+#endif
+        )
         {
             hash_entry->key2 = mcumax.hash_key2;
             hash_entry->score = iter_score;
@@ -557,9 +1465,35 @@ static int32_t mcumax_search(int32_t alpha,
                                       8 * (iter_score > alpha) |
                                       MCUMAX_SQUARE_INVALID * (iter_score < beta);
             hash_entry->square_to = iter_square_to;
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+            hash_entry->piece_key = piece_key;
+            hash_entry->position_key = position_key;
+#endif
         }
 #endif
 
+        // Root: score of the last complete iteration
+        if ((mode == MCUMAX_SEARCH_BEST_MOVE) &&
+            (mcumax.square_from == MCUMAX_SQUARE_INVALID) &&
+            (iter_depth > 2) &&
+            !mcumax.stop_search)
+        {
+            mcumax.search_score = iter_score;
+            mcumax.search_depth = iter_depth - 2;
+
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+            mcumax.iteration_node_counts[0] = mcumax.iteration_node_counts[1];
+            mcumax.iteration_node_counts[1] = mcumax.node_count - mcumax.iteration_start_count;
+#endif
+
+#ifdef MCUMAX_PV_ENABLED
+            memcpy(mcumax.pv, mcumax.pv_lines[0], sizeof(mcumax.pv));
+            mcumax.pv_num = mcumax.pv_lines_num[0];
+            mcumax.pv_played = 0;
+            mcumax.pv_depth = iter_depth;
+#endif
+        }
+
         // Kibitz
         // if (in_root)
         //     printf("%2d %6d %10d %c%c%c%c\n",
@@ -576,6 +1510,39 @@ static int32_t mcumax_search(int32_t alpha,
     return iter_score += iter_score < score;
 }
 
+#ifdef MCUMAX_SPECIALIZED_SEARCH_ENABLED
+// Interior nodes
+static int32_t mcumax_search(int32_t alpha,
+                             int32_t beta,
+                             int32_t score,
+                             uint8_t en_passant_square,
+                             uint8_t depth)
+{
+    return mcumax_search_node(alpha,
+                              beta,
+                              score,
+                              en_passant_square,
+                              depth,
+                              MCUMAX_INTERNAL_NODE);
+}
+
+// Root and utility searches: best move, valid moves and playing a move
+static int32_t mcumax_search_root(int32_t alpha,
+                                  int32_t beta,
+                                  int32_t score,
+                                  uint8_t en_passant_square,
+                                  uint8_t depth,
+                                  enum mcumax_mode mode)
+{
+    return mcumax_search_node(alpha,
+                              beta,
+                              score,
+                              en_passant_square,
+                              depth,
+                              mode);
+}
+#endif
+
 /***************************************************************************/
 
 void mcumax_init()
@@ -600,22 +1567,35 @@ void mcumax_init()
     mcumax.en_passant_square = MCUMAX_SQUARE_INVALID;
     mcumax.non_pawn_material = 0;
 
+    // New position: all squares changed
+    mcumax.changed_squares[0] = MCUMAX_SQUARE_INVALID;
+    mcumax.changed_squares[1] = 1;
+
+#ifdef MCUMAX_PV_ENABLED
+    mcumax.pv_num = 0;
+    mcumax.pv_played = 0;
+#endif
+
 #ifdef MCUMAX_HASHING_ENABLED
     mcumax.hash_key = 0;
     mcumax.hash_key2 = 0;
 
     memset(mcumax_hash_table, 0, sizeof(mcumax_hash_table));
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+    memset(mcumax_hash_near_table, 0, sizeof(mcumax_hash_near_table));
+#endif
 
-    // for (uint32_t i = MCUMAX_HASH_SCRAMBLE_TABLE_SIZE - 1; i > MCUMAX_BOARD_MASK; i--)
-    //     mcumax_scramble_table[i] = rand() & 0xff;
-
+    // Empty squares hash to 0, so keys only depend on the position
     srand(1);
-    for (uint32_t i = 0; i < 1035; i++)
-        mcumax_scramble_table[i] =
-            ((rand() & 0xff) << 0) |
-            ((rand() & 0xff) << 8) |
-            ((rand() & 0xff) << 16) |
-            ((rand() & 0xff) << 24);
+    for (uint32_t i = MCUMAX_BOARD_MASK + 1; i < MCUMAX_HASH_SCRAMBLE_TABLE_SIZE; i++)
+        mcumax_scramble_table[i] = rand() & 0xff;
+#endif
+
+#ifdef MCUMAX_REPETITION_ENABLED
+    mcumax.history_num = 0;
+    mcumax.reversible_plies = 0;
+
+    mcumax_init_cuckoo();
 #endif
 }
 
@@ -831,7 +1811,8 @@ mcumax_piece mcumax_get_current_side(void)
 static int32_t mcumax_start_search(enum mcumax_mode mode,
                                    mcumax_move move,
                                    uint32_t depth_max,
-                                   uint32_t node_max)
+                                   uint32_t node_max,
+                                   int32_t beta)
 {
     mcumax.square_from = move.from;
     mcumax.square_to = move.to;
@@ -840,14 +1821,70 @@ static int32_t mcumax_start_search(enum mcumax_mode mode,
     mcumax.node_count = 0;
     mcumax.depth_max = depth_max;
 
+    mcumax.search_score = 0;
+    mcumax.search_depth = 0;
+
+#ifdef MCUMAX_HASH_STATS_ENABLED
+    mcumax.hash_probe_count = 0;
+    mcumax.hash_hit_count = 0;
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+    mcumax.hash_near_hit_count = 0;
+#endif
+#endif
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    mcumax.hash_verified_count = 0;
+    mcumax.hash_alias_count = 0;
+    mcumax.hash_collision_count = 0;
+    mcumax.hash_collision_used_count = 0;
+#endif
+
+#ifdef MCUMAX_REPETITION_ENABLED
+    mcumax.repetition_cut_count = 0;
+#endif
+
+#ifdef MCUMAX_PROBCUT_ENABLED
+    mcumax.probcut_try_count = 0;
+    mcumax.probcut_cut_count = 0;
+#endif
+
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    mcumax.iteration_node_counts[0] = 0;
+    mcumax.iteration_node_counts[1] = 0;
+    mcumax.iteration_skip_count = 0;
+    mcumax.iteration_skip_nodes = 0;
+#endif
+
+#ifdef MCUMAX_MOBILITY_ENABLED
+    mcumax.mobility = 0;
+#endif
+
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+    mcumax.king_attacks = 0;
+
+    // Locate the kings; the search moves them incrementally
+    for (uint8_t square = 0; square < 0x80; square = (square + 9) & ~0x08)
+        if ((mcumax.board[square] & 0b111) == 4)
+            mcumax.king_squares[(mcumax.board[square] & MCUMAX_BOARD_BLACK) >> 4] = square;
+#endif
+
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    mcumax.eval_full_count = 0;
+    mcumax.eval_lazy_count = 0;
+#endif
+
+#ifdef MCUMAX_PV_ENABLED
+    mcumax.ply = 0;
+    mcumax.pv_follow = 0;
+#endif
+
     mcumax.stop_search = false;
 
-    return mcumax_search(-MCUMAX_SCORE_MAX,
-                         MCUMAX_SCORE_MAX,
-                         mcumax.score,
-                         mcumax.en_passant_square,
-                         3,
-                         mode);
+    return mcumax_search_root(-MCUMAX_SCORE_MAX,
+                              beta,
+                              mcumax.score,
+                              mcumax.en_passant_square,
+                              3,
+                              mode);
 }
 
 uint32_t mcumax_search_valid_moves(mcumax_move *valid_moves_buffer, uint32_t valid_moves_buffer_size)
@@ -856,7 +1893,7 @@ uint32_t mcumax_search_valid_moves(mcumax_move *valid_moves_buffer, uint32_t val
     mcumax.valid_moves_buffer = valid_moves_buffer;
     mcumax.valid_moves_buffer_size = valid_moves_buffer_size;
 
-    mcumax_start_search(MCUMAX_SEARCH_VALID_MOVES, MCUMAX_MOVE_INVALID, 0, 0);
+    mcumax_start_search(MCUMAX_SEARCH_VALID_MOVES, MCUMAX_MOVE_INVALID, 0, 0, MCUMAX_SCORE_MAX);
 
     return mcumax.valid_moves_num;
 }
@@ -864,7 +1901,8 @@ uint32_t mcumax_search_valid_moves(mcumax_move *valid_moves_buffer, uint32_t val
 mcumax_move mcumax_search_best_move(uint32_t node_max, uint32_t depth_max)
 {
     int32_t score = mcumax_start_search(MCUMAX_SEARCH_BEST_MOVE,
-                                        MCUMAX_MOVE_INVALID, depth_max + 3, node_max);
+                                        MCUMAX_MOVE_INVALID, depth_max + 3, node_max,
+                                        MCUMAX_SCORE_MAX);
 
     if (score == MCUMAX_SCORE_MAX)
         return (mcumax_move){mcumax.square_from, mcumax.square_to};
@@ -872,9 +1910,71 @@ mcumax_move mcumax_search_best_move(uint32_t node_max, uint32_t depth_max)
         return MCUMAX_MOVE_INVALID;
 }
 
+#ifndef MCUMAX_MINIMAL_ENABLED
+mcumax_move mcumax_search_best_move_bounded(uint32_t node_max, uint32_t depth_max,
+                                            int32_t score_max)
+{
+    if (score_max >= MCUMAX_SCORE_MAX)
+        return mcumax_search_best_move(node_max, depth_max);
+
+    mcumax_start_search(MCUMAX_SEARCH_BEST_MOVE,
+                        MCUMAX_MOVE_INVALID, depth_max + 3, node_max,
+                        score_max);
+
+    // The root returns its bound instead of MCUMAX_SCORE_MAX: check the
+    // move against the valid moves on a copy. Playing it would lock its
+    // position in the hash table as a draw, though it may never be played
+    mcumax_move move = {mcumax.square_from, mcumax.square_to};
+    mcumax_struct state = mcumax;
+    mcumax_move valid_moves[MCUMAX_VALID_MOVES_MAX];
+    uint32_t valid_moves_num = mcumax_search_valid_moves(valid_moves, MCUMAX_VALID_MOVES_MAX);
+    bool is_valid = false;
+    mcumax = state;
+
+    for (uint32_t i = 0; (i < valid_moves_num) && (i < MCUMAX_VALID_MOVES_MAX); i++)
+        if ((valid_moves[i].from == move.from) &&
+            (valid_moves[i].to == move.to))
+            is_valid = true;
+
+    return is_valid ? move : MCUMAX_MOVE_INVALID;
+}
+#endif
+
 bool mcumax_play_move(mcumax_move move)
 {
-    return mcumax_start_search(MCUMAX_PLAY_MOVE, move, 0, 0) == MCUMAX_SCORE_MAX;
+    // None, unless played
+    mcumax.changed_squares[0] = MCUMAX_SQUARE_INVALID;
+    mcumax.changed_squares[1] = 0;
+
+    if (mcumax_start_search(MCUMAX_PLAY_MOVE, move, 0, 0, MCUMAX_SCORE_MAX) != MCUMAX_SCORE_MAX)
+        return false;
+
+#ifdef MCUMAX_PV_ENABLED
+    // Keep following the PV while its moves are played
+    if ((mcumax.pv_played < mcumax.pv_num) &&
+        (move.from == mcumax.pv[mcumax.pv_played].from) &&
+        (move.to == (mcumax.pv[mcumax.pv_played].to & ~MCUMAX_SQUARE_INVALID)))
+        mcumax.pv_played++;
+    else
+        mcumax.pv_num = 0;
+#endif
+
+    return true;
+}
+
+uint64_t mcumax_get_changed_squares(void)
+{
+    uint64_t changed_squares = 0;
+
+    if (mcumax.changed_squares[0] == MCUMAX_SQUARE_INVALID)
+        return mcumax.changed_squares[1] ? UINT64_MAX : 0;
+
+    // Invalid rook squares: no castling
+    for (uint32_t i = 0; i < sizeof(mcumax.changed_squares); i++)
+        if (!(mcumax.changed_squares[i] & MCUMAX_BOARD_MASK))
+            changed_squares |= MCUMAX_SQUARE_BIT(mcumax.changed_squares[i]);
+
+    return changed_squares;
 }
 
 void mcumax_set_callback(mcumax_callback callback, void *userdata)
@@ -888,251 +1988,323 @@ void mcumax_stop_search(void)
     mcumax.stop_search = true;
 }
 
-bool mcumax_is_in_check(uint8_t side) {
-    uint8_t king_mask = (side == MCUMAX_BOARD_WHITE) ? MCUMAX_BOARD_WHITE : MCUMAX_BOARD_BLACK;
-    uint8_t enemy_mask = (side == MCUMAX_BOARD_WHITE) ? MCUMAX_BOARD_BLACK : MCUMAX_BOARD_WHITE;
-    mcumax_square king_square = MCUMAX_SQUARE_INVALID;
-    
-    // Find the king
-    for (int y = 0; y < 8; y++) {
-        for (int x = 0; x < 8; x++) {
-            mcumax_square sq = y * 16 + x;
-            uint8_t raw = mcumax.board[sq];
-            if ((raw & king_mask) && ((raw & 0b111) == MCUMAX_KING)) {
-                king_square = sq;
-                break;
-            }
+#ifdef MCUMAX_PARALLEL_ENABLED
+void mcumax_set_threads(uint32_t threads_num)
+{
+    mcumax_threads_num = (threads_num < MCUMAX_PARALLEL_THREADS_MAX)
+                             ? threads_num
+                             : MCUMAX_PARALLEL_THREADS_MAX;
+}
+#endif
+
+#ifdef MCUMAX_TUNING_ENABLED
+void mcumax_set_params(const mcumax_params *params)
+{
+    mcumax_tuning = *params;
+
+    // Null move searches must be shallower, reduced searches at least one ply deep
+    if (mcumax_tuning.null_move_reduction < 1)
+        mcumax_tuning.null_move_reduction = 1;
+    if (mcumax_tuning.reduction_depth < 2)
+        mcumax_tuning.reduction_depth = 2;
+}
+
+void mcumax_get_params(mcumax_params *params)
+{
+    *params = mcumax_tuning;
+}
+#endif
+
+#ifndef MCUMAX_MINIMAL_ENABLED
+#define MCUMAX_ATTACKER(TYPE) (1 << (TYPE))
+#define MCUMAX_ATTACKERS_ORTHOGONAL \
+    (MCUMAX_ATTACKER(MCUMAX_ROOK) | MCUMAX_ATTACKER(MCUMAX_QUEEN))
+#define MCUMAX_ATTACKERS_DIAGONAL \
+    (MCUMAX_ATTACKER(MCUMAX_BISHOP) | MCUMAX_ATTACKER(MCUMAX_QUEEN))
+
+// Attackers of a square by direction, as piece type masks: from the adjacent
+// square and from farther along the ray. Only the opponent's pieces count,
+// so each pawn type only appears on the side it attacks from.
+static const struct
+{
+    int8_t vector;
+    uint8_t near_attackers;
+    uint8_t far_attackers;
+} mcumax_attack_directions[] = {
+    {1, MCUMAX_ATTACKERS_ORTHOGONAL | MCUMAX_ATTACKER(MCUMAX_KING), MCUMAX_ATTACKERS_ORTHOGONAL},
+    {-1, MCUMAX_ATTACKERS_ORTHOGONAL | MCUMAX_ATTACKER(MCUMAX_KING), MCUMAX_ATTACKERS_ORTHOGONAL},
+    {16, MCUMAX_ATTACKERS_ORTHOGONAL | MCUMAX_ATTACKER(MCUMAX_KING), MCUMAX_ATTACKERS_ORTHOGONAL},
+    {-16, MCUMAX_ATTACKERS_ORTHOGONAL | MCUMAX_ATTACKER(MCUMAX_KING), MCUMAX_ATTACKERS_ORTHOGONAL},
+    {15, MCUMAX_ATTACKERS_DIAGONAL | MCUMAX_ATTACKER(MCUMAX_KING) | MCUMAX_ATTACKER(MCUMAX_PAWN_UPSTREAM), MCUMAX_ATTACKERS_DIAGONAL},
+    {17, MCUMAX_ATTACKERS_DIAGONAL | MCUMAX_ATTACKER(MCUMAX_KING) | MCUMAX_ATTACKER(MCUMAX_PAWN_UPSTREAM), MCUMAX_ATTACKERS_DIAGONAL},
+    {-15, MCUMAX_ATTACKERS_DIAGONAL | MCUMAX_ATTACKER(MCUMAX_KING) | MCUMAX_ATTACKER(MCUMAX_PAWN_DOWNSTREAM), MCUMAX_ATTACKERS_DIAGONAL},
+    {-17, MCUMAX_ATTACKERS_DIAGONAL | MCUMAX_ATTACKER(MCUMAX_KING) | MCUMAX_ATTACKER(MCUMAX_PAWN_DOWNSTREAM), MCUMAX_ATTACKERS_DIAGONAL},
+    {14, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {18, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {31, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {33, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {-14, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {-18, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {-31, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+    {-33, MCUMAX_ATTACKER(MCUMAX_KNIGHT), 0},
+};
+
+// Checks if a square is attacked by the opponent of the given side
+static bool mcumax_is_attacked(uint8_t square, uint8_t side)
+{
+    uint8_t opponent = side ^ 0x18;
+
+    for (uint32_t i = 0; i < sizeof(mcumax_attack_directions) / sizeof(mcumax_attack_directions[0]); i++)
+    {
+        int8_t vector = mcumax_attack_directions[i].vector;
+        uint8_t attackers = mcumax_attack_directions[i].near_attackers;
+        uint8_t attack_square = square + vector;
+        uint8_t piece;
+
+        if (attack_square & MCUMAX_BOARD_MASK)
+            continue;
+
+        piece = mcumax.board[attack_square];
+
+        // Sliders: first piece along the ray
+        if (!piece && mcumax_attack_directions[i].far_attackers)
+        {
+            attackers = mcumax_attack_directions[i].far_attackers;
+
+            do
+                attack_square += vector;
+            while (!(attack_square & MCUMAX_BOARD_MASK) &&
+                   !(piece = mcumax.board[attack_square]));
         }
-        if (king_square != MCUMAX_SQUARE_INVALID) break;
+
+        if ((piece & opponent) &&
+            ((attackers >> (piece & 0b111)) & 1))
+            return true;
     }
-    
-    if (king_square == MCUMAX_SQUARE_INVALID)
-        return false;
-    
-    // Directions: horizontal/vertical then diagonals
-    int directions[8] = {1, -1, 16, -16, 15, -15, 17, -17};
-    
-    // Scan rays for rooks, bishops and queens
-    for (int d = 0; d < 8; d++) {
-        int current_sq = king_square;
-        
-        while (1) {
-            current_sq += directions[d];
-            
-            // Check 0x88 board limits
-            if (current_sq & 0x88) {
-                break;
-            }
-            
-            uint8_t raw = mcumax.board[current_sq];
-            if (raw) {
-                // If it's an enemy piece
-                if (raw & enemy_mask) {
-                    int type = raw & 0b111;
-                    // Rook or queen on lines/columns (directions 0-3)
-                    if ((d < 4) && (type == MCUMAX_ROOK || type == MCUMAX_QUEEN)) {
-                        return true;
-                    }
-                    // Bishop or queen on diagonals (directions 4-7)
-                    if ((d >= 4) && (type == MCUMAX_BISHOP || type == MCUMAX_QUEEN)) {
-                        return true;
-                    }
-                }
-                // A piece blocks the ray, stop
-                break;
-            }
+
+    return false;
+}
+
+// Finds a piece (color and type), testing a rank's 8 squares at once
+static uint8_t mcumax_find_piece(uint8_t piece)
+{
+    const uint64_t bytes = 0x0101010101010101ULL;
+
+    for (uint8_t rank = 0; rank < 0x80; rank += 0x10)
+    {
+        uint64_t squares;
+        memcpy(&squares, mcumax.board + rank, sizeof(squares));
+
+        // Zero bytes mark matches; the first match is exact
+        squares = (squares & (0x1f * bytes)) ^ (piece * bytes);
+        if ((squares - bytes) & ~squares & (0x80 * bytes))
+        {
+            for (uint8_t square = rank; square < rank + 8; square++)
+                if ((mcumax.board[square] & 0x1f) == piece)
+                    return square;
         }
     }
-    
-    // Check knights
-    int knight_moves[8] = {14, 18, 31, 33, -14, -18, -31, -33};
-    for (int i = 0; i < 8; i++) {
-        int sq = king_square + knight_moves[i];
-        if (!(sq & 0x88)) {
-            uint8_t raw = mcumax.board[sq];
-            if ((raw & enemy_mask) && ((raw & 0b111) == MCUMAX_KNIGHT)) {
-                return true;
-            }
-        }
+
+    return MCUMAX_SQUARE_INVALID;
+}
+
+#ifdef MCUMAX_REPETITION_ENABLED
+// Cuckoo table of reversible piece moves, keyed by their hash key change
+// (after Marcel van Kervinck's upcoming-repetition detection). The second
+// hash takes the top bits: the scramble table's words overlap, so bits 16+
+// of a key repeat the low bits of its neighbour squares' keys.
+#define MCUMAX_CUCKOO_SIZE 0x2000
+#define MCUMAX_CUCKOO_H1(KEY) ((KEY) & (MCUMAX_CUCKOO_SIZE - 1))
+#define MCUMAX_CUCKOO_H2(KEY) ((KEY) >> 19)
+
+struct CuckooEntry
+{
+    uint32_t key;
+    uint8_t piece;
+    // Move from square_from to square_to, step by step
+    uint8_t square_from;
+    uint8_t square_to;
+    int8_t step;
+};
+
+static struct CuckooEntry mcumax_cuckoo_table[MCUMAX_CUCKOO_SIZE];
+
+static void mcumax_insert_cuckoo(struct CuckooEntry entry)
+{
+    uint32_t index = MCUMAX_CUCKOO_H1(entry.key);
+
+    // Displace entries to their other slot until one is free; on a cycle
+    // the last entry is dropped, which only misses its repetitions
+    for (uint32_t i = 0; i < MCUMAX_CUCKOO_SIZE; i++)
+    {
+        struct CuckooEntry displaced = mcumax_cuckoo_table[index];
+
+        mcumax_cuckoo_table[index] = entry;
+        if (!displaced.key)
+            return;
+
+        entry = displaced;
+        index = (index == MCUMAX_CUCKOO_H1(entry.key))
+                    ? MCUMAX_CUCKOO_H2(entry.key)
+                    : MCUMAX_CUCKOO_H1(entry.key);
     }
-    
-    // Check pawns
-    int pawn_dir = (side == MCUMAX_BOARD_WHITE) ? -16 : 16;
-    int pawn_attacks[2] = {pawn_dir - 1, pawn_dir + 1};
-    for (int i = 0; i < 2; i++) {
-        int sq = king_square + pawn_attacks[i];
-        if (!(sq & 0x88)) {
-            uint8_t raw = mcumax.board[sq];
-            if (raw & enemy_mask) {
-                int type = raw & 0b111;
-                // White pawn attacks upward (UPSTREAM), black pawn downward (DOWNSTREAM)
-                if ((side == MCUMAX_BOARD_WHITE && type == MCUMAX_PAWN_DOWNSTREAM) ||
-                    (side == MCUMAX_BOARD_BLACK && type == MCUMAX_PAWN_UPSTREAM)) {
-                    return true;
+}
+
+// One entry per piece and unordered pair of squares it moves between
+static void mcumax_init_cuckoo(void)
+{
+    static const uint8_t types[] = {
+        MCUMAX_KNIGHT, MCUMAX_KING, MCUMAX_BISHOP, MCUMAX_ROOK, MCUMAX_QUEEN};
+
+    memset(mcumax_cuckoo_table, 0, sizeof(mcumax_cuckoo_table));
+
+    for (uint8_t color = MCUMAX_BOARD_WHITE; color <= MCUMAX_BOARD_BLACK; color += 0x8)
+        for (uint32_t i = 0; i < sizeof(types); i++)
+            for (uint8_t square_from = 0; square_from < 0x80; square_from = (square_from + 9) & ~0x08)
+                for (uint32_t j = 0; j < sizeof(mcumax_attack_directions) / sizeof(mcumax_attack_directions[0]); j++)
+                {
+                    int8_t vector = mcumax_attack_directions[j].vector;
+                    uint8_t square_to = square_from;
+
+                    if (!((mcumax_attack_directions[j].near_attackers >> types[i]) & 1))
+                        continue;
+
+                    do
+                    {
+                        square_to += vector;
+                        if (square_to & MCUMAX_BOARD_MASK)
+                            break;
+
+                        if (square_from < square_to)
+                        {
+                            struct CuckooEntry entry;
+                            uint8_t piece = color | types[i];
+
+                            entry.key = HashScramble(square_to, piece) -
+                                        HashScramble(square_from, piece);
+                            entry.piece = piece;
+                            entry.square_from = square_from;
+                            entry.square_to = square_to;
+                            entry.step = vector;
+
+                            if (entry.key)
+                                mcumax_insert_cuckoo(entry);
+                        }
+                    } while ((mcumax_attack_directions[j].far_attackers >> types[i]) & 1);
                 }
-            }
+}
+
+static const struct CuckooEntry *mcumax_find_cuckoo(uint32_t key)
+{
+    const struct CuckooEntry *entry = &mcumax_cuckoo_table[MCUMAX_CUCKOO_H1(key)];
+
+    if (entry->key == key)
+        return entry;
+
+    entry = &mcumax_cuckoo_table[MCUMAX_CUCKOO_H2(key)];
+
+    return (entry->key == key) ? entry : NULL;
+}
+
+// Checks if a reversible move of the side to move reaches a position of the
+// key history, without generating moves
+static bool mcumax_is_repetition_upcoming(void)
+{
+    uint8_t plies_num = (mcumax.reversible_plies < mcumax.history_num)
+                            ? mcumax.reversible_plies
+                            : mcumax.history_num;
+
+    for (uint8_t i = 3; i <= plies_num; i += 2)
+    {
+        uint8_t index = mcumax.history_num - i;
+        uint32_t key_delta = mcumax.key_history[index] - mcumax.hash_key;
+        const struct CuckooEntry *entry;
+        uint8_t square_from;
+        uint8_t square_to;
+        int8_t step;
+
+        if ((entry = mcumax_find_cuckoo(key_delta)))
+        {
+            square_from = entry->square_from;
+            square_to = entry->square_to;
+            step = entry->step;
         }
-    }
-    
-    // Check opposing king (adjacent attack)
-    int king_moves[8] = {1, -1, 16, -16, 15, -15, 17, -17};
-    for (int i = 0; i < 8; i++) {
-        int sq = king_square + king_moves[i];
-        if (!(sq & 0x88)) {
-            uint8_t raw = mcumax.board[sq];
-            if ((raw & enemy_mask) && ((raw & 0b111) == MCUMAX_KING)) {
-                return true;
-            }
+        else if ((entry = mcumax_find_cuckoo(-key_delta)))
+        {
+            square_from = entry->square_to;
+            square_to = entry->square_from;
+            step = -entry->step;
         }
+        else
+            continue;
+
+        uint8_t piece = entry->piece;
+
+        // The piece is ours and the move is not blocked
+        if (((mcumax.board[square_from] & 0x1f) != piece) ||
+            !(piece & mcumax.current_side) ||
+            mcumax.board[square_to])
+            continue;
+
+        uint8_t square = square_from + step;
+        while ((square != square_to) && !mcumax.board[square])
+            square += step;
+        if (square != square_to)
+            continue;
+
+        // Second key against collisions
+        if (mcumax.key2_history[index] - mcumax.hash_key2 !=
+            HashScramble(square_to + 8, piece) - HashScramble(square_from + 8, piece))
+            continue;
+
+        // Pseudo-legal search: the opponent may have left its king en prise
+        uint8_t opponent = mcumax.current_side ^ 0x18;
+        uint8_t king_square = mcumax_find_piece(opponent | MCUMAX_KING);
+
+        return (king_square == MCUMAX_SQUARE_INVALID) ||
+               !mcumax_is_attacked(king_square, opponent);
     }
-    
+
     return false;
 }
+#endif
 
-bool mcumax_is_in_checkmate(uint8_t side) {
-    // 1. Check if the king is in check (necessary condition for mate)
-    if (!mcumax_is_in_check(side)) {
-        return false; // Not in check = not mate
-    }
-    
-    // 2. Save the current engine state
-    uint8_t board_backup[sizeof(mcumax.board)];
-    memcpy(board_backup, mcumax.board, sizeof(mcumax.board));
-    uint8_t current_side_backup = mcumax.current_side;
-    uint8_t en_passant_backup = mcumax.en_passant_square;
-    int32_t score_backup = mcumax.score;
-    int32_t npm_backup = mcumax.non_pawn_material;
-    
-    // 3. Make sure it's the tested side's turn
-    mcumax.current_side = side;
-    
-    // 4. Generate all possible legal moves
-    mcumax_move valid_moves[256]; // Buffer large enough for all possible moves
-    uint32_t moves_count = mcumax_search_valid_moves(valid_moves, 256);
-    
-    // 5. Test each move to see if it gets the king out of check
-    for (uint32_t i = 0; i < moves_count; i++) {
-        // Save state before playing the move
-        uint8_t temp_board[sizeof(mcumax.board)];
-        memcpy(temp_board, mcumax.board, sizeof(mcumax.board));
-        uint8_t temp_en_passant = mcumax.en_passant_square;
-        int32_t temp_score = mcumax.score;
-        int32_t temp_npm = mcumax.non_pawn_material;
-        
-        // Play the move temporarily
-        if (mcumax_play_move(valid_moves[i])) {
-            // Check if the king is still in check after this move
-            bool still_in_check = mcumax_is_in_check(side);
-            
-            // Restore state
-            memcpy(mcumax.board, temp_board, sizeof(mcumax.board));
-            mcumax.en_passant_square = temp_en_passant;
-            mcumax.score = temp_score;
-            mcumax.non_pawn_material = temp_npm;
-            mcumax.current_side = side;
-            
-            // If this move gets the king out of check, it's not mate
-            if (!still_in_check) {
-                // Restore full engine state
-                memcpy(mcumax.board, board_backup, sizeof(mcumax.board));
-                mcumax.current_side = current_side_backup;
-                mcumax.en_passant_square = en_passant_backup;
-                mcumax.score = score_backup;
-                mcumax.non_pawn_material = npm_backup;
-                return false;
-            }
-        } else {
-            // The move could not be played, restore anyway
-            memcpy(mcumax.board, temp_board, sizeof(mcumax.board));
-            mcumax.en_passant_square = temp_en_passant;
-            mcumax.score = temp_score;
-            mcumax.non_pawn_material = temp_npm;
-            mcumax.current_side = side;
-        }
-    }
-    
-    // 6. Restore full engine state
-    memcpy(mcumax.board, board_backup, sizeof(mcumax.board));
-    mcumax.current_side = current_side_backup;
-    mcumax.en_passant_square = en_passant_backup;
-    mcumax.score = score_backup;
-    mcumax.non_pawn_material = npm_backup;
-    
-    // 7. If no move gets out of check, it's mate
-    return true;
+bool mcumax_is_in_check(uint8_t side)
+{
+    uint8_t color = (side == MCUMAX_BOARD_WHITE) ? MCUMAX_BOARD_WHITE : MCUMAX_BOARD_BLACK;
+    uint8_t king_square = mcumax_find_piece(color | MCUMAX_KING);
+
+    if (king_square == MCUMAX_SQUARE_INVALID)
+        return false;
+
+    return mcumax_is_attacked(king_square, color);
 }
 
-bool mcumax_is_stalemate(uint8_t side) {
-    // 1. Check if the king is NOT in check (necessary condition for stalemate)
-    if (mcumax_is_in_check(side)) {
-        return false; // In check = not stalemate (potentially mate)
-    }
-    
-    // 2. Save the current engine state
-    uint8_t board_backup[sizeof(mcumax.board)];
-    memcpy(board_backup, mcumax.board, sizeof(mcumax.board));
-    uint8_t current_side_backup = mcumax.current_side;
-    uint8_t en_passant_backup = mcumax.en_passant_square;
-    int32_t score_backup = mcumax.score;
-    int32_t npm_backup = mcumax.non_pawn_material;
-    
-    // 3. Make sure it's the tested side's turn
+// Counts the legal moves of a side. The valid move list only holds legal
+// moves, so none is played; the whole engine state is restored, keeping the
+// last move's changed squares, the PV and the game history
+static uint32_t mcumax_count_legal_moves(uint8_t side)
+{
+    mcumax_struct state = mcumax;
+
     mcumax.current_side = side;
-    
-    // 4. Generate all possible legal moves
-    mcumax_move valid_moves[256]; // Buffer large enough for all possible moves
-    uint32_t moves_count = mcumax_search_valid_moves(valid_moves, 256);
-    
-    // 5. Test each move to see if it is really legal (does not put own king in check)
-    for (uint32_t i = 0; i < moves_count; i++) {
-        // Save state before playing the move
-        uint8_t temp_board[sizeof(mcumax.board)];
-        memcpy(temp_board, mcumax.board, sizeof(mcumax.board));
-        uint8_t temp_en_passant = mcumax.en_passant_square;
-        int32_t temp_score = mcumax.score;
-        int32_t temp_npm = mcumax.non_pawn_material;
-        
-        // Play the move temporarily
-        if (mcumax_play_move(valid_moves[i])) {
-            // Check if this move puts own king in check (illegal move)
-            bool puts_own_king_in_check = mcumax_is_in_check(side);
-            
-            // Restore state
-            memcpy(mcumax.board, temp_board, sizeof(mcumax.board));
-            mcumax.en_passant_square = temp_en_passant;
-            mcumax.score = temp_score;
-            mcumax.non_pawn_material = temp_npm;
-            mcumax.current_side = side;
-            
-            // If this move is legal (does not put own king in check), it's not stalemate
-            if (!puts_own_king_in_check) {
-                // Restore full engine state
-                memcpy(mcumax.board, board_backup, sizeof(mcumax.board));
-                mcumax.current_side = current_side_backup;
-                mcumax.en_passant_square = en_passant_backup;
-                mcumax.score = score_backup;
-                mcumax.non_pawn_material = npm_backup;
-                return false;
-            }
-        } else {
-            // The move could not be played, restore anyway
-            memcpy(mcumax.board, temp_board, sizeof(mcumax.board));
-            mcumax.en_passant_square = temp_en_passant;
-            mcumax.score = temp_score;
-            mcumax.non_pawn_material = temp_npm;
-            mcumax.current_side = side;
-        }
-    }
-    
-    // 6. Restore full engine state
-    memcpy(mcumax.board, board_backup, sizeof(mcumax.board));
-    mcumax.current_side = current_side_backup;
-    mcumax.en_passant_square = en_passant_backup;
-    mcumax.score = score_backup;
-    mcumax.non_pawn_material = npm_backup;
-    
-    // 7. If no legal move is available and the king is not in check, it's stalemate
-    return true;
+    uint32_t moves_num = mcumax_search_valid_moves(NULL, 0);
+
+    mcumax = state;
+
+    return moves_num;
+}
+
+bool mcumax_is_in_checkmate(uint8_t side)
+{
+    return mcumax_is_in_check(side) &&
+           !mcumax_count_legal_moves(side);
+}
+
+bool mcumax_is_stalemate(uint8_t side)
+{
+    return !mcumax_is_in_check(side) &&
+           !mcumax_count_legal_moves(side);
 }
 
 void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
@@ -1216,7 +2388,7 @@ void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
     *ptr++ = (mcumax.current_side == MCUMAX_BOARD_WHITE) ? 'w' : 'b';
     remaining -= 2;
     
-    // 3. Castling rights
+    // 3. Castling rights: unmoved king and rook on their start squares
     if (remaining < 2) return;
     *ptr++ = ' ';
     remaining--;
@@ -1224,7 +2396,8 @@ void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
     bool has_castling = false;
     
     // White king-side castling (K)
-    if (!(mcumax.board[0x74] & MCUMAX_PIECE_MOVED) && !(mcumax.board[0x77] & MCUMAX_PIECE_MOVED)) {
+    if (((mcumax.board[0x74] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_KING) &&
+        ((mcumax.board[0x77] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_ROOK)) {
         if (remaining < 1) return;
         *ptr++ = 'K';
         remaining--;
@@ -1232,7 +2405,8 @@ void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
     }
     
     // White queen-side castling (Q)
-    if (!(mcumax.board[0x74] & MCUMAX_PIECE_MOVED) && !(mcumax.board[0x70] & MCUMAX_PIECE_MOVED)) {
+    if (((mcumax.board[0x74] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_KING) &&
+        ((mcumax.board[0x70] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_ROOK)) {
         if (remaining < 1) return;
         *ptr++ = 'Q';
         remaining--;
@@ -1240,7 +2414,8 @@ void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
     }
     
     // Black king-side castling (k)
-    if (!(mcumax.board[0x04] & MCUMAX_PIECE_MOVED) && !(mcumax.board[0x07] & MCUMAX_PIECE_MOVED)) {
+    if (((mcumax.board[0x04] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_KING) &&
+        ((mcumax.board[0x07] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_ROOK)) {
         if (remaining < 1) return;
         *ptr++ = 'k';
         remaining--;
@@ -1248,7 +2423,8 @@ void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
     }
     
     // Black queen-side castling (q)
-    if (!(mcumax.board[0x04] & MCUMAX_PIECE_MOVED) && !(mcumax.board[0x00] & MCUMAX_PIECE_MOVED)) {
+    if (((mcumax.board[0x04] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_KING) &&
+        ((mcumax.board[0x00] & (MCUMAX_PIECE_MOVED | 0b111)) == MCUMAX_ROOK)) {
         if (remaining < 1) return;
         *ptr++ = 'q';
         remaining--;
@@ -1297,3 +2473,4 @@ void mcumax_get_fen(char* fen_buffer, size_t buffer_size) {
     // End the string
     *ptr = '\0';
 }
+#endif
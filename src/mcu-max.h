@@ -28,9 +28,42 @@ extern "C" {
 #define MCUMAX_BOARD_WHITE 0x8
 #define MCUMAX_BOARD_BLACK 0x10
 
+#if defined(MCUMAX_REPETITION_ENABLED) && !defined(MCUMAX_HISTORY_SIZE)
+// Repetition detection: keys of the game and search path
+#define MCUMAX_HISTORY_SIZE 200
+#endif
+
+#if defined(MCUMAX_HASH_VERIFY_ENABLED) && !defined(MCUMAX_HASH_STATS_ENABLED)
+// Hash statistics: probe and hit counters (implied by collision diagnostics)
+#define MCUMAX_HASH_STATS_ENABLED
+#endif
+
+#if defined(MCUMAX_PV_ENABLED) && !defined(MCUMAX_PV_LENGTH)
+// PV seeding: principal variation plies kept between searches
+#define MCUMAX_PV_LENGTH 6
+#endif
+
+// Bit of a square in a square set: 8 * rank + file (a8 is bit 0)
+#define MCUMAX_SQUARE_BIT(SQUARE) \
+    ((uint64_t)1 << ((((SQUARE) & 0x70) >> 1) | ((SQUARE) & 0x07)))
+
 #define MCUMAX_MOVE_INVALID \
     (mcumax_move) { MCUMAX_SQUARE_INVALID, MCUMAX_SQUARE_INVALID }
 
+// Thread-local engine state, so each thread runs its own engine (implied
+// by parallel search)
+#if !defined(MCUMAX_THREAD_LOCAL)
+#if defined(MCUMAX_PARALLEL_ENABLED) || defined(MCUMAX_THREAD_LOCAL_ENABLED)
+#if defined(__GNUC__)
+#define MCUMAX_THREAD_LOCAL __thread
+#else
+#define MCUMAX_THREAD_LOCAL _Thread_local
+#endif
+#else
+#define MCUMAX_THREAD_LOCAL
+#endif
+#endif
+
 typedef uint8_t mcumax_square;
 typedef uint8_t mcumax_piece;
 
@@ -102,6 +135,9 @@ uint32_t mcumax_search_valid_moves(mcumax_move *buffer, uint32_t buffer_size);
  * @param node_max The maximum number of nodes to search.
  * @param depth_max The maximum depth to search.
  *
+ * The score (side to move, a pawn is about 74) and depth of the last
+ * complete iteration are left in mcumax.search_score and mcumax.search_depth.
+ *
  * @return The best move (MCUMAX_SQUARE_INVALID, MCUMAX_SQUARE_INVALID if none found).
  */
 mcumax_move mcumax_search_best_move(uint32_t node_max, uint32_t depth_max);
@@ -114,6 +150,19 @@ mcumax_move mcumax_search_best_move(uint32_t node_max, uint32_t depth_max);
  */
 bool mcumax_play_move(mcumax_move move);
 
+/**
+ * @brief Returns the squares changed by the last mcumax_play_move().
+ *
+ * Besides the move's from and to squares (where a pawn may have promoted),
+ * the set includes the rook's squares when castling and the captured pawn's
+ * square on an en-passant capture, so a display can redraw only these.
+ * After mcumax_init() or mcumax_set_fen_position(), all squares are set;
+ * after a move that was not played, none.
+ *
+ * @return The squares as a set of MCUMAX_SQUARE_BIT() bits.
+ */
+uint64_t mcumax_get_changed_squares(void);
+
 /**
  * @brief Sets the user callback, which is called periodically during search.
  */
@@ -124,6 +173,88 @@ void mcumax_set_callback(mcumax_callback callback, void *userdata);
  */
 void mcumax_stop_search(void);
 
+#ifdef MCUMAX_PARALLEL_ENABLED
+/**
+ * @brief Sets the number of search threads.
+ *
+ * With 0 threads (the default), the search runs serially. With 1 or more
+ * threads, the root is split after its first move is searched, and the
+ * remaining root moves are searched with the first move's window.
+ * The result and node count are then independent of the number of threads.
+ * Engine state, including the thread count, is per thread, so each thread
+ * can run its own engine; but the deferred root moves are kept in a single
+ * job pool, so only one engine at a time may search with threads.
+ * Threads are POSIX threads, or FreeRTOS tasks with MCUMAX_THREAD_FREERTOS
+ * (see mcu-max-thread.h).
+ *
+ * @param threads_num The number of threads.
+ */
+void mcumax_set_threads(uint32_t threads_num);
+#endif
+
+#ifdef MCUMAX_TUNING_ENABLED
+/**
+ * Search parameters (defaults in mcu-max.c).
+ */
+typedef struct
+{
+    // Depth reduction of the null move search
+    int32_t null_move_reduction;
+    // Material (non_pawn_material) above which null moves do not prune
+    int32_t null_move_material;
+    // Iteration depth above which quiet non-pawn moves are reduced
+    int32_t reduction_depth;
+    // Material above which checks are not extended
+    int32_t check_extension_material;
+    // Material above which king moves are not penalized
+    int32_t king_freeze_material;
+    int32_t king_freeze_penalty;
+#ifdef MCUMAX_PROBCUT_ENABLED
+    int32_t probcut_margin;
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    int32_t lazy_eval_margin;
+#endif
+} mcumax_params;
+
+/**
+ * @brief Sets the search parameters of the calling thread's engine.
+ *
+ * Parameters are kept across mcumax_init() and mcumax_set_fen_position(),
+ * and are passed on to the threads of a parallel search. The null move
+ * reduction is raised to at least 1 and the reduction depth to at least 2.
+ *
+ * @param params The parameters.
+ */
+void mcumax_set_params(const mcumax_params *params);
+
+/**
+ * @brief Gets the search parameters of the calling thread's engine.
+ *
+ * @param params The parameters.
+ */
+void mcumax_get_params(mcumax_params *params);
+#endif
+
+#ifndef MCUMAX_MINIMAL_ENABLED
+/**
+ * @brief Searches the best move, proving scores only up to a bound.
+ *
+ * Like mcumax_search_best_move(), but the search stops as soon as it proves
+ * that the position is worth score_max or more, which is much cheaper than
+ * an exact score. A search_score of score_max - 1 or more is then only a
+ * lower bound, and no move is returned if the bound was reached by null-move
+ * pruning before any move was searched. Searches from FEN start at score 0,
+ * so the bound is relative to the position's material.
+ *
+ * @param node_max The maximum number of nodes to search.
+ * @param depth_max The maximum depth to search.
+ * @param score_max The score bound (above -8000; 8000 for none).
+ * @return The best move (MCUMAX_SQUARE_INVALID, MCUMAX_SQUARE_INVALID if none found).
+ */
+mcumax_move mcumax_search_best_move_bounded(uint32_t node_max, uint32_t depth_max,
+                                            int32_t score_max);
+
 /**
  * Checks if the king of the given side is in check.
  */
@@ -131,11 +262,13 @@ bool mcumax_is_in_check(uint8_t side);
 
 /**
  * Checks if the king of the given side is in checkmate.
+ * The engine state, including mcumax_get_changed_squares(), is kept.
  */
 bool mcumax_is_in_checkmate(uint8_t side);
 
 /**
  * Checks if the king of the given side is in stalemate.
+ * The engine state, including mcumax_get_changed_squares(), is kept.
  */
 bool mcumax_is_stalemate(uint8_t side);
 
@@ -143,6 +276,7 @@ bool mcumax_is_stalemate(uint8_t side);
  * Exports the current position in FEN format.
  */
 void mcumax_get_fen(char* fen_buffer, size_t buffer_size);
+#endif
 
 typedef struct mcumax_struct {
     uint8_t board[0x80 + 1];
@@ -150,15 +284,87 @@ typedef struct mcumax_struct {
     int32_t score;
     uint8_t en_passant_square;
     int32_t non_pawn_material;
+    // Last move's from, to, captured, rook from and rook to squares
+    // (invalid if none); an invalid from square with a to square of 1
+    // marks a new position, of 0 a move that was not played
+    uint8_t changed_squares[5];
 #ifdef MCUMAX_HASHING_ENABLED
     uint32_t hash_key;
     uint32_t hash_key2;
+#ifdef MCUMAX_HASH_STATS_ENABLED
+    uint32_t hash_probe_count;
+    uint32_t hash_hit_count;
+#ifdef MCUMAX_HASH_NEAR_ENABLED
+    // Hits in the near table (included in hash_hit_count)
+    uint32_t hash_near_hit_count;
+#endif
+#endif
+#ifdef MCUMAX_HASH_VERIFY_ENABLED
+    // Hits checked against the full position: same position; same pieces
+    // but other moved flags, side to move or e.p. square (not in the keys);
+    // other pieces (key collisions), and those whose stored score was used
+    uint32_t hash_verified_count;
+    uint32_t hash_alias_count;
+    uint32_t hash_collision_count;
+    uint32_t hash_collision_used_count;
+#endif
+#endif
+#ifdef MCUMAX_REPETITION_ENABLED
+    // Keys of the positions before the current one, oldest first
+    uint32_t key_history[MCUMAX_HISTORY_SIZE];
+    uint32_t key2_history[MCUMAX_HISTORY_SIZE];
+    uint8_t history_num;
+    // Plies since the last capture, pawn move, castling or null move
+    uint8_t reversible_plies;
+    uint32_t repetition_cut_count;
+#endif
+#ifdef MCUMAX_PV_ENABLED
+    // PV of the last search (to squares flag replayable moves), its plies
+    // played since, and its root iteration depth
+    mcumax_move pv[MCUMAX_PV_LENGTH];
+    uint8_t pv_num;
+    uint8_t pv_played;
+    uint8_t pv_depth;
+    // Search: ply of the node, ply up to which the path follows the PV,
+    // and the triangular PV table
+    uint8_t ply;
+    uint8_t pv_follow;
+    mcumax_move pv_lines[MCUMAX_PV_LENGTH][MCUMAX_PV_LENGTH];
+    uint8_t pv_lines_num[MCUMAX_PV_LENGTH];
 #endif
     uint8_t square_from;
     uint8_t square_to;
     uint32_t node_count;
     uint32_t node_max;
+#ifdef MCUMAX_PROBCUT_ENABLED
+    // The next node is a ProbCut probe
+    bool probcut_node;
+    uint32_t probcut_try_count;
+    uint32_t probcut_cut_count;
+#endif
     uint32_t depth_max;
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    // Root: nodes at the start of the iteration, nodes of the last two
+    // complete iterations, and the iterations not started (with their
+    // predicted nodes) because they would have overrun node_max
+    uint32_t iteration_start_count;
+    uint32_t iteration_node_counts[2];
+    uint32_t iteration_skip_count;
+    uint32_t iteration_skip_nodes;
+#endif
+    int32_t search_score;
+    uint8_t search_depth;
+#ifdef MCUMAX_MOBILITY_ENABLED
+    uint8_t mobility;
+#endif
+#ifdef MCUMAX_KING_SAFETY_ENABLED
+    uint8_t king_squares[2];
+    uint8_t king_attacks;
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    uint32_t eval_full_count;
+    uint32_t eval_lazy_count;
+#endif
     bool stop_search;
     mcumax_callback user_callback;
     void *user_data;
@@ -167,7 +373,7 @@ typedef struct mcumax_struct {
     uint32_t valid_moves_num;
 } mcumax_struct;
 
-extern mcumax_struct mcumax;
+extern MCUMAX_THREAD_LOCAL mcumax_struct mcumax;
 
 #ifdef __cplusplus
 }
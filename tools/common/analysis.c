@@ -0,0 +1,337 @@
+/*
+ * mcu-max tools
+ * Binary analysis protocol
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "analysis.h"
+
+#define ANALYSIS_CASTLING_WHITE_KING 0x1
+#define ANALYSIS_CASTLING_WHITE_QUEEN 0x2
+#define ANALYSIS_CASTLING_BLACK_KING 0x4
+#define ANALYSIS_CASTLING_BLACK_QUEEN 0x8
+
+// FEN letters by mcumax_piece; '\0' marks invalid nibbles
+static const char analysis_piece_chars[16] = {
+    0, 'P', 0, 'N', 'K', 'B', 'R', 'Q',
+    0, 0, 'p', 'n', 'k', 'b', 'r', 'q'};
+
+static void analysis_put_u32(uint8_t *p, uint32_t value)
+{
+    for (uint32_t i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+}
+
+static uint32_t analysis_get_u32(const uint8_t *p)
+{
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < 4; i++)
+        value |= (uint32_t)p[i] << (8 * i);
+
+    return value;
+}
+
+static uint8_t analysis_get_square(const analysis_position *position, uint32_t index)
+{
+    return (position->squares[index >> 1] >> (4 * (index & 1))) & 0xf;
+}
+
+static void analysis_set_square(analysis_position *position, uint32_t index, uint8_t piece)
+{
+    position->squares[index >> 1] |= piece << (4 * (index & 1));
+}
+
+bool analysis_pack_fen(const char *fen, analysis_position *position)
+{
+    memset(position, 0, sizeof(*position));
+    position->en_passant = MCUMAX_SQUARE_INVALID;
+
+    // Board
+    uint32_t index = 0;
+    char c;
+
+    while ((c = *fen++) && (c != ' '))
+    {
+        if ((c >= '1') && (c <= '8'))
+            index += c - '0';
+        else if (c == '/')
+        {
+            if (index & 7)
+                return false;
+        }
+        else
+        {
+            const char *piece_char = memchr(analysis_piece_chars, c, sizeof(analysis_piece_chars));
+            if (!piece_char || (index >= 64))
+                return false;
+
+            analysis_set_square(position, index++, piece_char - analysis_piece_chars);
+        }
+
+        if (index > 64)
+            return false;
+    }
+
+    if ((index != 64) || (c != ' '))
+        return false;
+
+    // Side
+    if (*fen == 'b')
+        position->side = 1;
+    else if (*fen != 'w')
+        return false;
+    fen++;
+
+    if (*fen++ != ' ')
+        return false;
+
+    // Castling
+    while ((c = *fen++) && (c != ' '))
+    {
+        switch (c)
+        {
+        case 'K':
+            position->castling |= ANALYSIS_CASTLING_WHITE_KING;
+
+            break;
+
+        case 'Q':
+            position->castling |= ANALYSIS_CASTLING_WHITE_QUEEN;
+
+            break;
+
+        case 'k':
+            position->castling |= ANALYSIS_CASTLING_BLACK_KING;
+
+            break;
+
+        case 'q':
+            position->castling |= ANALYSIS_CASTLING_BLACK_QUEEN;
+
+            break;
+
+        case '-':
+            break;
+
+        default:
+            return false;
+        }
+    }
+
+    // En passant (optional)
+    if ((c == ' ') &&
+        (fen[0] >= 'a') && (fen[0] <= 'h') &&
+        (fen[1] >= '1') && (fen[1] <= '8'))
+        position->en_passant = 16 * ('8' - fen[1]) + (fen[0] - 'a');
+
+    return true;
+}
+
+bool analysis_unpack_fen(const analysis_position *position, char *fen)
+{
+    uint32_t kings_num[2] = {0, 0};
+    char *s = fen;
+
+    for (uint32_t rank = 0; rank < 8; rank++)
+    {
+        uint32_t empty_num = 0;
+
+        for (uint32_t file = 0; file < 8; file++)
+        {
+            uint8_t piece = analysis_get_square(position, 8 * rank + file);
+
+            if (piece == MCUMAX_EMPTY)
+            {
+                empty_num++;
+
+                continue;
+            }
+
+            char piece_char = analysis_piece_chars[piece];
+            if (!piece_char)
+                return false;
+
+            if ((piece & 0x7) == MCUMAX_KING)
+                kings_num[piece >> 3]++;
+
+            if (empty_num)
+                *s++ = '0' + empty_num;
+            empty_num = 0;
+
+            *s++ = piece_char;
+        }
+
+        if (empty_num)
+            *s++ = '0' + empty_num;
+        if (rank < 7)
+            *s++ = '/';
+    }
+
+    if ((kings_num[0] != 1) || (kings_num[1] != 1) || (position->side > 1))
+        return false;
+
+    *s++ = ' ';
+    *s++ = position->side ? 'b' : 'w';
+    *s++ = ' ';
+
+    if (!position->castling)
+        *s++ = '-';
+    if (position->castling & ANALYSIS_CASTLING_WHITE_KING)
+        *s++ = 'K';
+    if (position->castling & ANALYSIS_CASTLING_WHITE_QUEEN)
+        *s++ = 'Q';
+    if (position->castling & ANALYSIS_CASTLING_BLACK_KING)
+        *s++ = 'k';
+    if (position->castling & ANALYSIS_CASTLING_BLACK_QUEEN)
+        *s++ = 'q';
+
+    *s++ = ' ';
+
+    if (position->en_passant & MCUMAX_SQUARE_INVALID)
+        *s++ = '-';
+    else if (position->en_passant & 0x08)
+        return false;
+    else
+    {
+        *s++ = 'a' + (position->en_passant & 0x7);
+        *s++ = '8' - (position->en_passant >> 4);
+    }
+
+    strcpy(s, " 0 1");
+
+    return true;
+}
+
+size_t analysis_encode_request(const analysis_request *request, uint8_t *frame)
+{
+    analysis_put_u32(frame, ANALYSIS_REQUEST_SIZE);
+    analysis_put_u32(frame + 4, request->id);
+    analysis_put_u32(frame + 8, request->node_max);
+    frame[12] = request->depth_max;
+    analysis_put_u32(frame + 13, request->score_max);
+    memcpy(frame + 17, request->position.squares, 32);
+    frame[49] = request->position.side;
+    frame[50] = request->position.castling;
+    frame[51] = request->position.en_passant;
+
+    return 4 + ANALYSIS_REQUEST_SIZE;
+}
+
+bool analysis_decode_request(const uint8_t *payload, uint32_t payload_size,
+                             analysis_request *request)
+{
+    if (payload_size >= 4)
+        request->id = analysis_get_u32(payload);
+
+    if (payload_size != ANALYSIS_REQUEST_SIZE)
+        return false;
+
+    request->node_max = analysis_get_u32(payload + 4);
+    request->depth_max = payload[8];
+    request->score_max = (int32_t)analysis_get_u32(payload + 9);
+    memcpy(request->position.squares, payload + 13, 32);
+    request->position.side = payload[45];
+    request->position.castling = payload[46];
+    request->position.en_passant = payload[47];
+
+    return true;
+}
+
+size_t analysis_encode_response(const analysis_response *response, uint8_t *frame)
+{
+    analysis_put_u32(frame, ANALYSIS_RESPONSE_SIZE);
+    analysis_put_u32(frame + 4, response->id);
+    frame[8] = response->status;
+    frame[9] = response->flags;
+    frame[10] = response->move.from;
+    frame[11] = response->move.to;
+    analysis_put_u32(frame + 12, response->score);
+    frame[16] = response->depth;
+    analysis_put_u32(frame + 17, response->nodes_num);
+    analysis_put_u32(frame + 21, response->time_us);
+
+    return 4 + ANALYSIS_RESPONSE_SIZE;
+}
+
+bool analysis_decode_response(const uint8_t *payload, uint32_t payload_size,
+                              analysis_response *response)
+{
+    if (payload_size != ANALYSIS_RESPONSE_SIZE)
+        return false;
+
+    response->id = analysis_get_u32(payload);
+    response->status = payload[4];
+    response->flags = payload[5];
+    response->move.from = payload[6];
+    response->move.to = payload[7];
+    response->score = (int32_t)analysis_get_u32(payload + 8);
+    response->depth = payload[12];
+    response->nodes_num = analysis_get_u32(payload + 13);
+    response->time_us = analysis_get_u32(payload + 17);
+
+    return true;
+}
+
+static bool analysis_read(int fd, uint8_t *buffer, size_t size)
+{
+    while (size)
+    {
+        ssize_t read_size = read(fd, buffer, size);
+        if (read_size < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+        if (!read_size)
+            return false;
+
+        buffer += read_size;
+        size -= read_size;
+    }
+
+    return true;
+}
+
+bool analysis_read_frame(int fd, uint8_t *payload, uint32_t *payload_size)
+{
+    uint8_t header[4];
+
+    if (!analysis_read(fd, header, sizeof(header)))
+        return false;
+
+    *payload_size = analysis_get_u32(header);
+    if (*payload_size > ANALYSIS_FRAME_SIZE_MAX)
+        return false;
+
+    return analysis_read(fd, payload, *payload_size);
+}
+
+bool analysis_write(int fd, const uint8_t *buffer, size_t size)
+{
+    while (size)
+    {
+        ssize_t write_size = write(fd, buffer, size);
+        if (write_size < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        buffer += write_size;
+        size -= write_size;
+    }
+
+    return true;
+}
@@ -0,0 +1,164 @@
+/*
+ * mcu-max tools
+ * Binary analysis protocol
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(ANALYSIS_H)
+#define ANALYSIS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mcu-max.h"
+
+// Frames are a payload size (u32) followed by the payload. Integers are
+// little-endian; squares are 0x88 squares as in the engine.
+//
+//   request   id (u32), node limit (u32), depth limit (u8),
+//             score bound (i32), position
+//   response  id (u32), status (u8), flags (u8), move from (u8),
+//             move to (u8), score (i32), depth (u8), nodes (u32),
+//             time in microseconds (u32)
+//
+// A packed position is 35 bytes:
+//
+//   squares     32 bytes, one mcumax_piece per nibble from a8 to h1,
+//               low nibble first
+//   side        0 for white, 1 for black
+//   castling    bit 0: K, bit 1: Q, bit 2: k, bit 3: q
+//   en passant  the en-passant square, MCUMAX_SQUARE_INVALID if none
+//
+// Responses are sent as searches finish, not in request order.
+//
+// A search stops proving scores at the score bound (ANALYSIS_SCORE_MAX for
+// none): a response with ANALYSIS_FLAG_LOWER_BOUND only shows that the
+// position is worth at least its score, and its move may be invalid.
+
+#define ANALYSIS_POSITION_SIZE 35
+#define ANALYSIS_REQUEST_SIZE (13 + ANALYSIS_POSITION_SIZE)
+#define ANALYSIS_RESPONSE_SIZE 21
+#define ANALYSIS_FRAME_SIZE_MAX 256
+
+#define ANALYSIS_FEN_SIZE 128
+
+// Engine score range (mates are near its ends)
+#define ANALYSIS_SCORE_MAX 8000
+
+typedef enum
+{
+    ANALYSIS_STATUS_OK,
+    ANALYSIS_STATUS_INVALID_REQUEST,
+    ANALYSIS_STATUS_NO_MOVES,
+} analysis_status;
+
+// Response flags
+#define ANALYSIS_FLAG_CACHED 0x1
+#define ANALYSIS_FLAG_LOWER_BOUND 0x2
+
+typedef struct
+{
+    uint8_t squares[32];
+    uint8_t side;
+    uint8_t castling;
+    uint8_t en_passant;
+} analysis_position;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t node_max;
+    uint8_t depth_max;
+    int32_t score_max;
+    analysis_position position;
+} analysis_request;
+
+typedef struct
+{
+    uint32_t id;
+    analysis_status status;
+    uint8_t flags;
+    mcumax_move move;
+    int32_t score;
+    uint8_t depth;
+    uint32_t nodes_num;
+    uint32_t time_us;
+} analysis_response;
+
+/**
+ * @brief Packs a FEN position.
+ *
+ * @param fen The FEN string (move counters are ignored).
+ * @param position The packed position.
+ * @return The FEN string is valid.
+ */
+bool analysis_pack_fen(const char *fen, analysis_position *position);
+
+/**
+ * @brief Unpacks a position to FEN.
+ *
+ * @param position The packed position.
+ * @param fen A buffer of at least ANALYSIS_FEN_SIZE characters.
+ * @return The position is valid (known pieces, one king per side).
+ */
+bool analysis_unpack_fen(const analysis_position *position, char *fen);
+
+/**
+ * @brief Encodes a request frame.
+ *
+ * @param request The request.
+ * @param frame A buffer of at least 4 + ANALYSIS_REQUEST_SIZE bytes.
+ * @return The frame size.
+ */
+size_t analysis_encode_request(const analysis_request *request, uint8_t *frame);
+
+/**
+ * @brief Decodes a request payload.
+ *
+ * @param payload The payload.
+ * @param payload_size The payload size.
+ * @param request The request; its id is set if the payload holds one.
+ * @return The payload is a valid request.
+ */
+bool analysis_decode_request(const uint8_t *payload, uint32_t payload_size,
+                             analysis_request *request);
+
+/**
+ * @brief Encodes a response frame.
+ *
+ * @param response The response.
+ * @param frame A buffer of at least 4 + ANALYSIS_RESPONSE_SIZE bytes.
+ * @return The frame size.
+ */
+size_t analysis_encode_response(const analysis_response *response, uint8_t *frame);
+
+/**
+ * @brief Decodes a response payload.
+ *
+ * @return The payload is a valid response.
+ */
+bool analysis_decode_response(const uint8_t *payload, uint32_t payload_size,
+                              analysis_response *response);
+
+/**
+ * @brief Reads a frame from a file descriptor.
+ *
+ * @param fd The file descriptor.
+ * @param payload A buffer of ANALYSIS_FRAME_SIZE_MAX bytes.
+ * @param payload_size The payload size.
+ * @return A frame was read; false on end of file, errors and oversized frames.
+ */
+bool analysis_read_frame(int fd, uint8_t *payload, uint32_t *payload_size);
+
+/**
+ * @brief Writes a buffer to a file descriptor, retrying short writes.
+ *
+ * @return The buffer was written.
+ */
+bool analysis_write(int fd, const uint8_t *buffer, size_t size);
+
+#endif
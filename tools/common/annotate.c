@@ -0,0 +1,158 @@
+/*
+ * mcu-max tools
+ * Whole-game annotation
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "annotate.h"
+
+// Replays a game, keeping the engine state before each ply and at the end
+static bool annotate_replay(const pgn_game *game, annotate_game *annotation,
+                            mcumax_struct *snapshots)
+{
+    memset(annotation, 0, sizeof(*annotation));
+
+    pgn_set_start_position(game);
+
+    for (uint32_t ply = 0; ply < game->moves_num; ply++)
+    {
+        mcumax_move move;
+
+        snapshots[ply] = mcumax;
+
+        if (!pgn_parse_san(game->moves[ply], &move) ||
+            !mcumax_play_move(move))
+        {
+            mcumax = snapshots[ply];
+
+            break;
+        }
+
+        annotation->plies[annotation->plies_num++].move = move;
+    }
+
+    snapshots[annotation->plies_num] = mcumax;
+
+    return annotation->plies_num == game->moves_num;
+}
+
+// Searches the engine's position; mates and stalemates need no search
+static int32_t annotate_search(uint32_t node_max, uint32_t depth_max,
+                               annotate_game *annotation,
+                               mcumax_move *best_move, uint8_t *depth)
+{
+    *best_move = MCUMAX_MOVE_INVALID;
+    *depth = 0;
+
+    if (!mcumax_search_valid_moves(NULL, 0))
+        return mcumax_is_in_check(mcumax_get_current_side())
+                   ? -ANNOTATE_SCORE_MATE
+                   : 0;
+
+    *best_move = mcumax_search_best_move(node_max, depth_max);
+    *depth = mcumax.search_depth;
+
+    annotation->searches_num++;
+    annotation->nodes_num += mcumax.node_count;
+
+    return mcumax.search_score;
+}
+
+static void annotate_judge(annotate_ply *ply)
+{
+    int32_t loss = ply->score - ply->move_score;
+
+    if ((ply->move.from == ply->best_move.from) &&
+        (ply->move.to == ply->best_move.to))
+        loss = 0;
+
+    ply->judgement = (loss >= ANNOTATE_BLUNDER_MARGIN)
+                         ? ANNOTATE_JUDGEMENT_BLUNDER
+                     : (loss >= ANNOTATE_MISTAKE_MARGIN)
+                         ? ANNOTATE_JUDGEMENT_MISTAKE
+                     : (loss >= ANNOTATE_INACCURACY_MARGIN)
+                         ? ANNOTATE_JUDGEMENT_INACCURACY
+                         : ANNOTATE_JUDGEMENT_NONE;
+}
+
+bool annotate_game_backwards(const pgn_game *game, uint32_t node_max, uint32_t depth_max,
+                             annotate_game *annotation)
+{
+    mcumax_struct *snapshots = malloc((PGN_MOVES_MAX + 1) * sizeof(mcumax_struct));
+    if (!snapshots)
+        return false;
+
+    bool is_complete = annotate_replay(game, annotation, snapshots);
+
+    // The score of a move is the negated score of the position it leads to
+    mcumax_move best_move;
+    uint8_t depth;
+
+    mcumax = snapshots[annotation->plies_num];
+    int32_t next_score = annotate_search(node_max, depth_max, annotation, &best_move, &depth);
+
+    for (uint32_t i = annotation->plies_num; i-- > 0;)
+    {
+        annotate_ply *ply = &annotation->plies[i];
+
+        mcumax = snapshots[i];
+        ply->score = annotate_search(node_max, depth_max, annotation, &ply->best_move, &ply->depth);
+        ply->move_score = -next_score;
+        annotate_judge(ply);
+
+        next_score = ply->score;
+    }
+
+    free(snapshots);
+
+    return is_complete;
+}
+
+bool annotate_game_independent(const pgn_game *game, uint32_t node_max, uint32_t depth_max,
+                               annotate_game *annotation)
+{
+    mcumax_struct *snapshots = malloc((PGN_MOVES_MAX + 1) * sizeof(mcumax_struct));
+    char(*fens)[PGN_FEN_SIZE] = malloc(PGN_MOVES_MAX * PGN_FEN_SIZE);
+    if (!snapshots || !fens)
+    {
+        free(snapshots);
+        free(fens);
+
+        return false;
+    }
+
+    bool is_complete = annotate_replay(game, annotation, snapshots);
+
+    for (uint32_t i = 0; i < annotation->plies_num; i++)
+    {
+        mcumax = snapshots[i];
+        mcumax_get_fen(fens[i], PGN_FEN_SIZE);
+    }
+
+    for (uint32_t i = 0; i < annotation->plies_num; i++)
+    {
+        annotate_ply *ply = &annotation->plies[i];
+        mcumax_move best_move;
+        uint8_t depth;
+
+        mcumax_set_fen_position(fens[i]);
+        ply->score = annotate_search(node_max, depth_max, annotation, &ply->best_move, &ply->depth);
+
+        mcumax_set_fen_position(fens[i]);
+        mcumax_play_move(ply->move);
+        ply->move_score = -annotate_search(node_max, depth_max, annotation, &best_move, &depth);
+
+        annotate_judge(ply);
+    }
+
+    free(snapshots);
+    free(fens);
+
+    return is_complete;
+}
@@ -0,0 +1,79 @@
+/*
+ * mcu-max tools
+ * Whole-game annotation
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(ANNOTATE_H)
+#define ANNOTATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mcu-max.h"
+#include "pgn.h"
+
+// Scores are in engine units (a pawn is about 74), for the side to move
+#define ANNOTATE_SCORE_MATE 8000
+
+// Score lost by the played move against the best move
+#define ANNOTATE_INACCURACY_MARGIN 37
+#define ANNOTATE_MISTAKE_MARGIN 74
+#define ANNOTATE_BLUNDER_MARGIN 222
+
+typedef enum
+{
+    ANNOTATE_JUDGEMENT_NONE,
+    ANNOTATE_JUDGEMENT_INACCURACY,
+    ANNOTATE_JUDGEMENT_MISTAKE,
+    ANNOTATE_JUDGEMENT_BLUNDER,
+} annotate_judgement;
+
+typedef struct
+{
+    mcumax_move move;
+    mcumax_move best_move;
+    int32_t score;
+    int32_t move_score;
+    uint8_t depth;
+    annotate_judgement judgement;
+} annotate_ply;
+
+typedef struct
+{
+    uint32_t plies_num;
+    annotate_ply plies[PGN_MOVES_MAX];
+
+    uint32_t searches_num;
+    uint64_t nodes_num;
+} annotate_game;
+
+/**
+ * @brief Annotates a game, walking backwards from its last position.
+ *
+ * Positions are replayed once and kept as engine snapshots. Searching the
+ * position after a move yields the move's score, so each ply needs one
+ * search: best move and score, played move score, and judgement.
+ *
+ * @param game The game; it is annotated up to the first invalid move.
+ * @param node_max The node limit per position.
+ * @param depth_max The depth limit per position.
+ * @param annotation The annotation.
+ * @return The game could be replayed and annotated.
+ */
+bool annotate_game_backwards(const pgn_game *game, uint32_t node_max, uint32_t depth_max,
+                             annotate_game *annotation);
+
+/**
+ * @brief Annotates a game with independent searches, for comparison.
+ *
+ * Each position is set up from FEN and searched twice: once for the best
+ * move, and once after the played move for its score.
+ */
+bool annotate_game_independent(const pgn_game *game, uint32_t node_max, uint32_t depth_max,
+                               annotate_game *annotation);
+
+#endif
@@ -0,0 +1,639 @@
+/*
+ * mcu-max tools
+ * Compact game archive
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <zlib.h>
+
+#include "archive.h"
+
+#define ARCHIVE_MAGIC "MCMA"
+#define ARCHIVE_TRAILER_MAGIC "MCMI"
+
+#define ARCHIVE_HEADER_SIZE 8
+#define ARCHIVE_BLOCK_HEADER_SIZE 12
+#define ARCHIVE_INDEX_ENTRY_SIZE 12
+#define ARCHIVE_TRAILER_SIZE 20
+
+#define ARCHIVE_GAME_SIZE_MAX (2 + PGN_FEN_SIZE + 5 + 2 * PGN_MOVES_MAX)
+
+#define ARCHIVE_FLAG_FEN 0x1
+
+#define ARCHIVE_BLOCK_NONE UINT32_MAX
+
+// Engine board flag of pieces that have moved (see mcu-max.c)
+#define ARCHIVE_PIECE_MOVED 0x20
+
+// At most 323 pseudo-legal moves (9 queens, 2 rooks, 2 bishops, 2 knights)
+#define ARCHIVE_MOVES_MAX 336
+
+// Move indices from 255 are stored as 0xff, index - 255
+#define ARCHIVE_MOVE_ESCAPE 0xff
+
+static void archive_put_u32(uint8_t *p, uint32_t value)
+{
+    for (uint32_t i = 0; i < 4; i++)
+        p[i] = value >> (8 * i);
+}
+
+static void archive_put_u64(uint8_t *p, uint64_t value)
+{
+    for (uint32_t i = 0; i < 8; i++)
+        p[i] = value >> (8 * i);
+}
+
+static uint32_t archive_get_u32(const uint8_t *p)
+{
+    uint32_t value = 0;
+
+    for (uint32_t i = 0; i < 4; i++)
+        value |= (uint32_t)p[i] << (8 * i);
+
+    return value;
+}
+
+static uint64_t archive_get_u64(const uint8_t *p)
+{
+    uint64_t value = 0;
+
+    for (uint32_t i = 0; i < 8; i++)
+        value |= (uint64_t)p[i] << (8 * i);
+
+    return value;
+}
+
+// Moves
+
+static const int8_t archive_knight_steps[] = {-33, -31, -18, -14, 14, 18, 31, 33};
+static const int8_t archive_king_steps[] = {-17, -16, -15, -1, 1, 15, 16, 17};
+static const int8_t archive_bishop_steps[] = {-17, -15, 15, 17};
+static const int8_t archive_rook_steps[] = {-16, -1, 1, 16};
+
+static uint32_t archive_add_steps(mcumax_move *moves,
+                                  uint32_t moves_num,
+                                  mcumax_square from,
+                                  const int8_t *steps,
+                                  uint32_t steps_num,
+                                  bool is_slider)
+{
+    uint8_t side = mcumax_get_current_side();
+
+    for (uint32_t i = 0; i < steps_num; i++)
+    {
+        mcumax_square to = from;
+
+        while (!((to += steps[i]) & 0x88))
+        {
+            uint8_t raw_piece = mcumax.board[to];
+
+            if (raw_piece & side)
+                break;
+
+            moves[moves_num++] = (mcumax_move){from, to};
+
+            if (raw_piece || !is_slider)
+                break;
+        }
+    }
+
+    return moves_num;
+}
+
+static bool archive_is_unmoved(mcumax_square square, uint8_t piece)
+{
+    uint8_t raw_piece = mcumax.board[square];
+
+    return ((raw_piece & 0x1f) == piece) &&
+           !(raw_piece & ARCHIVE_PIECE_MOVED);
+}
+
+// Pseudo-legal moves, in board order: a superset of the valid moves that
+// is much cheaper to generate and does not depend on the engine's search
+static uint32_t archive_get_moves(mcumax_move *moves)
+{
+    uint8_t side = mcumax_get_current_side();
+    uint8_t other_side = side ^ (MCUMAX_BOARD_WHITE | MCUMAX_BOARD_BLACK);
+    bool is_white = (side == MCUMAX_BOARD_WHITE);
+    int32_t forward = is_white ? -16 : 16;
+    mcumax_square home_row = is_white ? 0x70 : 0x00;
+    uint32_t moves_num = 0;
+
+    for (mcumax_square from = 0; from < 0x80; from = (from + 9) & ~0x08)
+    {
+        uint8_t raw_piece = mcumax.board[from];
+        if (!(raw_piece & side))
+            continue;
+
+        switch (raw_piece & 0x7)
+        {
+        case MCUMAX_PAWN_UPSTREAM:
+        case MCUMAX_PAWN_DOWNSTREAM:
+        {
+            mcumax_square to = from + forward;
+
+            for (int32_t i = -1; i <= 1; i += 2)
+            {
+                mcumax_square capture_square = to + i;
+                if (capture_square & 0x88)
+                    continue;
+
+                if ((mcumax.board[capture_square] & other_side) ||
+                    ((capture_square == mcumax.en_passant_square) &&
+                     !mcumax.board[capture_square]))
+                    moves[moves_num++] = (mcumax_move){from, capture_square};
+            }
+
+            if (!(to & 0x88) && !mcumax.board[to])
+            {
+                moves[moves_num++] = (mcumax_move){from, to};
+
+                to += forward;
+                if (((from & 0x70) == (home_row ^ 0x10)) &&
+                    !mcumax.board[to])
+                    moves[moves_num++] = (mcumax_move){from, to};
+            }
+
+            break;
+        }
+
+        case MCUMAX_KNIGHT:
+            moves_num = archive_add_steps(moves, moves_num, from,
+                                          archive_knight_steps, 8, false);
+
+            break;
+
+        case MCUMAX_KING:
+            moves_num = archive_add_steps(moves, moves_num, from,
+                                          archive_king_steps, 8, false);
+
+            // Castling, without checking attacked squares
+            if ((from == (home_row | 4)) &&
+                !(raw_piece & ARCHIVE_PIECE_MOVED))
+            {
+                if (archive_is_unmoved(home_row | 7, side | MCUMAX_ROOK) &&
+                    !mcumax.board[home_row | 5] &&
+                    !mcumax.board[home_row | 6])
+                    moves[moves_num++] = (mcumax_move){from, home_row | 6};
+                if (archive_is_unmoved(home_row | 0, side | MCUMAX_ROOK) &&
+                    !mcumax.board[home_row | 1] &&
+                    !mcumax.board[home_row | 2] &&
+                    !mcumax.board[home_row | 3])
+                    moves[moves_num++] = (mcumax_move){from, home_row | 2};
+            }
+
+            break;
+
+        case MCUMAX_BISHOP:
+            moves_num = archive_add_steps(moves, moves_num, from,
+                                          archive_bishop_steps, 4, true);
+
+            break;
+
+        case MCUMAX_ROOK:
+            moves_num = archive_add_steps(moves, moves_num, from,
+                                          archive_rook_steps, 4, true);
+
+            break;
+
+        case MCUMAX_QUEEN:
+            moves_num = archive_add_steps(moves, moves_num, from,
+                                          archive_king_steps, 8, true);
+
+            break;
+        }
+    }
+
+    return moves_num;
+}
+
+int32_t archive_encode_move(mcumax_move move)
+{
+    mcumax_move moves[ARCHIVE_MOVES_MAX];
+    uint32_t moves_num = archive_get_moves(moves);
+
+    for (uint32_t i = 0; i < moves_num; i++)
+    {
+        if ((moves[i].from == move.from) &&
+            (moves[i].to == move.to))
+            return i;
+    }
+
+    return -1;
+}
+
+mcumax_move archive_decode_move(uint32_t index)
+{
+    mcumax_move moves[ARCHIVE_MOVES_MAX];
+    uint32_t moves_num = archive_get_moves(moves);
+
+    if (index >= moves_num)
+        return MCUMAX_MOVE_INVALID;
+
+    return moves[index];
+}
+
+// Writer
+
+static bool archive_flush_block(archive_writer *writer)
+{
+    if (!writer->block_games_num)
+        return true;
+
+    if (writer->blocks_num == writer->blocks_capacity)
+    {
+        uint32_t blocks_capacity = writer->blocks_capacity ? 2 * writer->blocks_capacity : 64;
+        archive_block_info *blocks = realloc(writer->blocks,
+                                             blocks_capacity * sizeof(archive_block_info));
+        if (!blocks)
+            return false;
+
+        writer->blocks = blocks;
+        writer->blocks_capacity = blocks_capacity;
+    }
+
+    archive_block_info *block_info = &writer->blocks[writer->blocks_num++];
+    block_info->offset = writer->offset;
+    block_info->first_game = writer->games_num - writer->block_games_num;
+
+    uLongf compressed_size = compressBound(writer->block_size);
+    uint8_t *buffer = malloc(ARCHIVE_BLOCK_HEADER_SIZE + compressed_size);
+    if (!buffer)
+        return false;
+
+    bool success = (compress2(buffer + ARCHIVE_BLOCK_HEADER_SIZE, &compressed_size,
+                              writer->block, writer->block_size,
+                              Z_BEST_COMPRESSION) == Z_OK);
+
+    if (success)
+    {
+        archive_put_u32(buffer, writer->block_size);
+        archive_put_u32(buffer + 4, compressed_size);
+        archive_put_u32(buffer + 8, writer->block_games_num);
+
+        size_t size = ARCHIVE_BLOCK_HEADER_SIZE + compressed_size;
+        success = (fwrite(buffer, size, 1, writer->file) == 1);
+        writer->offset += size;
+    }
+
+    free(buffer);
+
+    writer->block_size = 0;
+    writer->block_games_num = 0;
+
+    return success;
+}
+
+bool archive_create(archive_writer *writer, const char *path)
+{
+    memset(writer, 0, sizeof(archive_writer));
+
+    writer->block = malloc(ARCHIVE_BLOCK_SIZE + ARCHIVE_GAME_SIZE_MAX);
+    if (!writer->block)
+        return false;
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file)
+    {
+        free(writer->block);
+
+        return false;
+    }
+
+    uint8_t header[ARCHIVE_HEADER_SIZE];
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    archive_put_u32(header + 4, ARCHIVE_VERSION);
+    writer->offset = ARCHIVE_HEADER_SIZE;
+
+    return fwrite(header, sizeof(header), 1, writer->file) == 1;
+}
+
+bool archive_write_game(archive_writer *writer, const archive_game *game)
+{
+    if ((game->result > PGN_RESULT_DRAW) ||
+        (game->moves_num > PGN_MOVES_MAX))
+        return false;
+
+    for (uint32_t i = 0; i < game->moves_num; i++)
+    {
+        if (game->moves[i] >= 2 * ARCHIVE_MOVE_ESCAPE)
+            return false;
+    }
+
+    uint8_t *p = writer->block + writer->block_size;
+
+    *p++ = game->result;
+    *p++ = game->fen[0] ? ARCHIVE_FLAG_FEN : 0;
+
+    if (game->fen[0])
+    {
+        size_t fen_size = strnlen(game->fen, PGN_FEN_SIZE - 1);
+
+        memcpy(p, game->fen, fen_size);
+        p += fen_size;
+        *p++ = '\0';
+    }
+
+    // Varint
+    uint32_t moves_num = game->moves_num;
+    while (moves_num >= 0x80)
+    {
+        *p++ = 0x80 | (moves_num & 0x7f);
+        moves_num >>= 7;
+    }
+    *p++ = moves_num;
+
+    for (uint32_t i = 0; i < game->moves_num; i++)
+    {
+        uint16_t index = game->moves[i];
+
+        if (index >= ARCHIVE_MOVE_ESCAPE)
+        {
+            *p++ = ARCHIVE_MOVE_ESCAPE;
+            index -= ARCHIVE_MOVE_ESCAPE;
+        }
+        *p++ = index;
+    }
+
+    writer->block_size = p - writer->block;
+    writer->block_games_num++;
+    writer->games_num++;
+
+    if (writer->block_size >= ARCHIVE_BLOCK_SIZE)
+        return archive_flush_block(writer);
+
+    return true;
+}
+
+bool archive_finish(archive_writer *writer)
+{
+    bool success = archive_flush_block(writer);
+
+    // Index
+    uint64_t index_offset = writer->offset;
+
+    for (uint32_t i = 0; success && (i < writer->blocks_num); i++)
+    {
+        uint8_t entry[ARCHIVE_INDEX_ENTRY_SIZE];
+
+        archive_put_u64(entry, writer->blocks[i].offset);
+        archive_put_u32(entry + 8, writer->blocks[i].first_game);
+
+        success = (fwrite(entry, sizeof(entry), 1, writer->file) == 1);
+    }
+
+    uint8_t trailer[ARCHIVE_TRAILER_SIZE];
+    archive_put_u64(trailer, index_offset);
+    archive_put_u32(trailer + 8, writer->blocks_num);
+    archive_put_u32(trailer + 12, writer->games_num);
+    memcpy(trailer + 16, ARCHIVE_TRAILER_MAGIC, 4);
+
+    if (success)
+        success = (fwrite(trailer, sizeof(trailer), 1, writer->file) == 1);
+
+    if (fclose(writer->file))
+        success = false;
+    writer->file = NULL;
+
+    free(writer->block);
+    writer->block = NULL;
+    free(writer->blocks);
+    writer->blocks = NULL;
+
+    return success;
+}
+
+// Reader
+
+bool archive_open(archive_reader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(archive_reader));
+    reader->block_index = ARCHIVE_BLOCK_NONE;
+
+    reader->file = fopen(path, "rb");
+    if (!reader->file)
+        return false;
+
+    uint8_t header[ARCHIVE_HEADER_SIZE];
+    uint8_t trailer[ARCHIVE_TRAILER_SIZE];
+
+    if ((fread(header, sizeof(header), 1, reader->file) != 1) ||
+        memcmp(header, ARCHIVE_MAGIC, 4) ||
+        (archive_get_u32(header + 4) != ARCHIVE_VERSION) ||
+        fseeko(reader->file, -ARCHIVE_TRAILER_SIZE, SEEK_END) ||
+        (fread(trailer, sizeof(trailer), 1, reader->file) != 1) ||
+        memcmp(trailer + 16, ARCHIVE_TRAILER_MAGIC, 4))
+    {
+        archive_close(reader);
+
+        return false;
+    }
+
+    uint64_t index_offset = archive_get_u64(trailer);
+    reader->blocks_num = archive_get_u32(trailer + 8);
+    reader->games_num = archive_get_u32(trailer + 12);
+
+    reader->blocks = malloc((reader->blocks_num ? reader->blocks_num : 1) *
+                            sizeof(archive_block_info));
+    if (!reader->blocks ||
+        fseeko(reader->file, index_offset, SEEK_SET))
+    {
+        archive_close(reader);
+
+        return false;
+    }
+
+    for (uint32_t i = 0; i < reader->blocks_num; i++)
+    {
+        uint8_t entry[ARCHIVE_INDEX_ENTRY_SIZE];
+
+        if (fread(entry, sizeof(entry), 1, reader->file) != 1)
+        {
+            archive_close(reader);
+
+            return false;
+        }
+
+        reader->blocks[i].offset = archive_get_u64(entry);
+        reader->blocks[i].first_game = archive_get_u32(entry + 8);
+    }
+
+    return true;
+}
+
+void archive_close(archive_reader *reader)
+{
+    if (reader->file)
+        fclose(reader->file);
+    reader->file = NULL;
+
+    free(reader->blocks);
+    reader->blocks = NULL;
+    free(reader->block);
+    reader->block = NULL;
+}
+
+static bool archive_load_block(archive_reader *reader, uint32_t block_index)
+{
+    uint8_t header[ARCHIVE_BLOCK_HEADER_SIZE];
+
+    reader->block_index = ARCHIVE_BLOCK_NONE;
+
+    if (fseeko(reader->file, reader->blocks[block_index].offset, SEEK_SET) ||
+        (fread(header, sizeof(header), 1, reader->file) != 1))
+        return false;
+
+    uLongf raw_size = archive_get_u32(header);
+    uint32_t compressed_size = archive_get_u32(header + 4);
+
+    if (raw_size > reader->block_capacity)
+    {
+        uint8_t *block = realloc(reader->block, raw_size);
+        if (!block)
+            return false;
+
+        reader->block = block;
+        reader->block_capacity = raw_size;
+    }
+
+    uint8_t *buffer = malloc(compressed_size ? compressed_size : 1);
+    if (!buffer)
+        return false;
+
+    uLongf block_size = raw_size;
+    bool success = (fread(buffer, compressed_size, 1, reader->file) == 1) &&
+                   (uncompress(reader->block, &block_size, buffer, compressed_size) == Z_OK) &&
+                   (block_size == raw_size);
+
+    free(buffer);
+
+    if (!success)
+        return false;
+
+    reader->block_index = block_index;
+    reader->block_size = block_size;
+    reader->block_offset = 0;
+    reader->game_index = reader->blocks[block_index].first_game;
+
+    return true;
+}
+
+static bool archive_parse_game(archive_reader *reader, archive_game *game)
+{
+    const uint8_t *p = reader->block + reader->block_offset;
+    const uint8_t *end = reader->block + reader->block_size;
+
+    if ((end - p) < 2)
+        return false;
+
+    game->result = *p++;
+    uint8_t flags = *p++;
+
+    if (game->result > PGN_RESULT_DRAW)
+        return false;
+
+    game->fen[0] = '\0';
+    if (flags & ARCHIVE_FLAG_FEN)
+    {
+        const uint8_t *fen_end = memchr(p, '\0', end - p);
+        if (!fen_end || ((fen_end - p) >= PGN_FEN_SIZE))
+            return false;
+
+        memcpy(game->fen, p, fen_end - p + 1);
+        p = fen_end + 1;
+    }
+
+    // Varint
+    uint32_t moves_num = 0;
+    for (uint32_t shift = 0;; shift += 7)
+    {
+        if ((p == end) || (shift > 28))
+            return false;
+
+        uint8_t c = *p++;
+        moves_num |= (uint32_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            break;
+    }
+
+    if (moves_num > PGN_MOVES_MAX)
+        return false;
+
+    for (uint32_t i = 0; i < moves_num; i++)
+    {
+        uint16_t index = 0;
+
+        if ((p != end) && (*p == ARCHIVE_MOVE_ESCAPE))
+        {
+            index = ARCHIVE_MOVE_ESCAPE;
+            p++;
+        }
+        if (p == end)
+            return false;
+
+        game->moves[i] = index + *p++;
+    }
+    game->moves_num = moves_num;
+
+    reader->block_offset = p - reader->block;
+    reader->game_index++;
+
+    return true;
+}
+
+bool archive_seek(archive_reader *reader, uint32_t game_index)
+{
+    if (game_index >= reader->games_num)
+        return false;
+
+    // Last block starting at or before the game
+    uint32_t low = 0;
+    uint32_t high = reader->blocks_num;
+    while ((high - low) > 1)
+    {
+        uint32_t middle = (low + high) / 2;
+
+        if (reader->blocks[middle].first_game <= game_index)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    if ((low != reader->block_index) ||
+        (reader->game_index > game_index))
+    {
+        if (!archive_load_block(reader, low))
+            return false;
+    }
+
+    archive_game game;
+    while (reader->game_index < game_index)
+    {
+        if (!archive_parse_game(reader, &game))
+            return false;
+    }
+
+    return true;
+}
+
+bool archive_read_game(archive_reader *reader, archive_game *game)
+{
+    if (reader->game_index >= reader->games_num)
+        return false;
+
+    if ((reader->block_index == ARCHIVE_BLOCK_NONE) ||
+        (reader->block_offset >= reader->block_size))
+    {
+        if (!archive_seek(reader, reader->game_index))
+            return false;
+    }
+
+    return archive_parse_game(reader, game);
+}
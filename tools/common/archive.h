@@ -0,0 +1,164 @@
+/*
+ * mcu-max tools
+ * Compact game archive
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(ARCHIVE_H)
+#define ARCHIVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mcu-max.h"
+#include "pgn.h"
+
+// Archive layout (integers are little-endian):
+//
+//   header   "MCMA", version (u32)
+//   blocks   raw size (u32), compressed size (u32), games (u32), zlib data
+//   index    per block: file offset (u64), first game (u32)
+//   trailer  index offset (u64), blocks (u32), games (u32), "MCMI"
+//
+// A block holds about ARCHIVE_BLOCK_SIZE bytes of games:
+//
+//   result (u8), flags (u8), [FEN, NUL-terminated], moves (varint),
+//   one move index per move (u8, or 0xff and u8 from index 255)
+//
+// Move indices refer to a pseudo-legal move list in board order, which is
+// generated without searching and does not change with the engine's
+// search or move ordering.
+
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_SIZE 0x10000
+
+typedef struct
+{
+    char fen[PGN_FEN_SIZE];
+    pgn_result result;
+    uint32_t moves_num;
+    uint16_t moves[PGN_MOVES_MAX];
+} archive_game;
+
+typedef struct
+{
+    uint64_t offset;
+    uint32_t first_game;
+} archive_block_info;
+
+typedef struct
+{
+    FILE *file;
+    uint64_t offset;
+
+    uint8_t *block;
+    size_t block_size;
+    uint32_t block_games_num;
+
+    archive_block_info *blocks;
+    uint32_t blocks_num;
+    uint32_t blocks_capacity;
+
+    uint32_t games_num;
+} archive_writer;
+
+typedef struct
+{
+    FILE *file;
+
+    archive_block_info *blocks;
+    uint32_t blocks_num;
+
+    uint32_t games_num;
+
+    uint8_t *block;
+    size_t block_size;
+    size_t block_capacity;
+    size_t block_offset;
+    uint32_t block_index;
+
+    uint32_t game_index;
+} archive_reader;
+
+/**
+ * @brief Encodes a move as its index in the engine's current position.
+ *
+ * @param move The move.
+ * @return The move index, -1 if the move is not pseudo-legal.
+ */
+int32_t archive_encode_move(mcumax_move move);
+
+/**
+ * @brief Decodes a move index in the engine's current position.
+ *
+ * The move is pseudo-legal: mcumax_play_move() rejects moves that leave
+ * the king in check.
+ *
+ * @param index The move index.
+ * @return The move (MCUMAX_MOVE_INVALID if invalid).
+ */
+mcumax_move archive_decode_move(uint32_t index);
+
+/**
+ * @brief Creates an archive.
+ *
+ * @param writer The writer.
+ * @param path The file path.
+ * @return The archive was created.
+ */
+bool archive_create(archive_writer *writer, const char *path);
+
+/**
+ * @brief Appends a game to an archive.
+ *
+ * @param writer The writer.
+ * @param game The game.
+ * @return The game was written.
+ */
+bool archive_write_game(archive_writer *writer, const archive_game *game);
+
+/**
+ * @brief Writes the last block and the game index, and closes the archive.
+ *
+ * @param writer The writer.
+ * @return The archive was written.
+ */
+bool archive_finish(archive_writer *writer);
+
+/**
+ * @brief Opens an archive and reads its game index.
+ *
+ * @param reader The reader.
+ * @param path The file path.
+ * @return The archive was opened.
+ */
+bool archive_open(archive_reader *reader, const char *path);
+
+/**
+ * @brief Closes an archive.
+ */
+void archive_close(archive_reader *reader);
+
+/**
+ * @brief Moves to a game. Only its block is decompressed.
+ *
+ * @param reader The reader.
+ * @param game_index The game index.
+ * @return The game exists.
+ */
+bool archive_seek(archive_reader *reader, uint32_t game_index);
+
+/**
+ * @brief Reads the next game.
+ *
+ * @param reader The reader.
+ * @param game The game.
+ * @return A game was read.
+ */
+bool archive_read_game(archive_reader *reader, archive_game *game);
+
+#endif
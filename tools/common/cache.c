@@ -0,0 +1,195 @@
+/*
+ * mcu-max tools
+ * Persistent analysis result cache
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_MAGIC "MCMC"
+
+#define CACHE_PROBES_NUM 8
+
+static uint32_t cache_get_u32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+
+    return value;
+}
+
+static void cache_put_u32(uint8_t *p, uint32_t value)
+{
+    memcpy(p, &value, sizeof(value));
+}
+
+bool cache_open(cache *cache, const char *path, uint32_t capacity)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    cache->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (cache->fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(cache->fd, &st))
+        goto error;
+
+    uint8_t header[CACHE_HEADER_SIZE];
+
+    if (!st.st_size)
+    {
+        // New cache
+        uint32_t power = 1;
+        while (power < capacity)
+            power <<= 1;
+        capacity = power;
+
+        memset(header, 0, sizeof(header));
+        memcpy(header, CACHE_MAGIC, 4);
+        cache_put_u32(header + 4, CACHE_VERSION);
+        cache_put_u32(header + 8, capacity);
+        cache_put_u32(header + 12, sizeof(cache_entry));
+
+        if ((pwrite(cache->fd, header, sizeof(header), 0) != sizeof(header)) ||
+            ftruncate(cache->fd, CACHE_HEADER_SIZE + (off_t)capacity * sizeof(cache_entry)))
+            goto error;
+    }
+    else if (pread(cache->fd, header, sizeof(header), 0) != sizeof(header))
+        goto error;
+
+    capacity = cache_get_u32(header + 8);
+
+    if (memcmp(header, CACHE_MAGIC, 4) ||
+        (cache_get_u32(header + 4) != CACHE_VERSION) ||
+        (cache_get_u32(header + 12) != sizeof(cache_entry)) ||
+        !capacity ||
+        (capacity & (capacity - 1)))
+        goto error;
+
+    cache->map_size = CACHE_HEADER_SIZE + (size_t)capacity * sizeof(cache_entry);
+    if (fstat(cache->fd, &st) ||
+        ((size_t)st.st_size < cache->map_size))
+        goto error;
+
+    cache->map = mmap(NULL, cache->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (cache->map == MAP_FAILED)
+        goto error;
+
+    cache->entries = (cache_entry *)(cache->map + CACHE_HEADER_SIZE);
+    cache->capacity = capacity;
+    pthread_mutex_init(&cache->mutex, NULL);
+
+    return true;
+
+error:
+    close(cache->fd);
+    cache->fd = -1;
+    cache->map = NULL;
+
+    return false;
+}
+
+void cache_close(cache *cache)
+{
+    if (!cache->map)
+        return;
+
+    msync(cache->map, cache->map_size, MS_SYNC);
+    munmap(cache->map, cache->map_size);
+    close(cache->fd);
+    pthread_mutex_destroy(&cache->mutex);
+
+    cache->map = NULL;
+}
+
+static uint64_t cache_get_key(uint64_t key)
+{
+    return key ? key : 1;
+}
+
+bool cache_lookup(cache *cache, uint64_t key, uint32_t node_max, uint8_t depth_max,
+                  cache_entry *entry)
+{
+    bool is_found = false;
+
+    key = cache_get_key(key);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    for (uint32_t i = 0; i < CACHE_PROBES_NUM; i++)
+    {
+        cache_entry *probe = &cache->entries[(key + i) & (cache->capacity - 1)];
+
+        if (!probe->key)
+            break;
+
+        if ((probe->key == key) &&
+            (probe->node_max >= node_max) &&
+            (probe->depth_max >= depth_max))
+        {
+            *entry = *probe;
+            is_found = true;
+
+            break;
+        }
+    }
+
+    if (is_found)
+        cache->hits_num++;
+    else
+        cache->misses_num++;
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    return is_found;
+}
+
+void cache_store(cache *cache, const cache_entry *entry)
+{
+    uint64_t key = cache_get_key(entry->key);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    cache_entry *victim = NULL;
+
+    for (uint32_t i = 0; i < CACHE_PROBES_NUM; i++)
+    {
+        cache_entry *probe = &cache->entries[(key + i) & (cache->capacity - 1)];
+
+        if (!probe->key || (probe->key == key))
+        {
+            // Keep deeper results
+            if (probe->key &&
+                (probe->node_max >= entry->node_max) &&
+                (probe->depth_max >= entry->depth_max))
+                victim = NULL;
+            else
+                victim = probe;
+
+            break;
+        }
+
+        // Other positions: replace the shallowest
+        if (!victim || (probe->depth < victim->depth))
+            victim = probe;
+    }
+
+    if (victim)
+    {
+        *victim = *entry;
+        victim->key = key;
+        cache->stores_num++;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,99 @@
+/*
+ * mcu-max tools
+ * Persistent analysis result cache
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(CACHE_H)
+#define CACHE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Cache file layout (host byte order, the file is memory-mapped):
+//
+//   header   "MCMC", version (u32), capacity (u32), entry size (u32),
+//            padding to CACHE_HEADER_SIZE bytes
+//   entries  capacity entries, open addressing with linear probing
+//
+// Key 0 marks an empty entry. The cache belongs to one process at a time;
+// as the mapping is shared, stores survive the process being killed.
+
+#define CACHE_VERSION 1
+#define CACHE_HEADER_SIZE 32
+#define CACHE_CAPACITY_DEFAULT (1 << 20)
+
+// Keys are Polyglot keys with this random seed (polyglot_init_random());
+// changing it invalidates existing cache files
+#define CACHE_KEY_SEED 0x6d63752d6d6178ULL
+
+typedef struct
+{
+    uint64_t key;
+    int32_t score;
+    uint32_t nodes_num;
+    uint32_t node_max;
+    uint8_t from;
+    uint8_t to;
+    uint8_t depth;
+    uint8_t depth_max;
+} cache_entry;
+
+typedef struct
+{
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+
+    cache_entry *entries;
+    uint32_t capacity;
+
+    pthread_mutex_t mutex;
+    uint64_t hits_num;
+    uint64_t misses_num;
+    uint64_t stores_num;
+} cache;
+
+/**
+ * @brief Opens a cache file, creating it if needed.
+ *
+ * @param cache The cache.
+ * @param path The file path.
+ * @param capacity The capacity of a new file, rounded up to a power of two.
+ * @return The cache was opened.
+ */
+bool cache_open(cache *cache, const char *path, uint32_t capacity);
+
+/**
+ * @brief Writes back and closes a cache.
+ */
+void cache_close(cache *cache);
+
+/**
+ * @brief Looks up a result searched with at least the given limits.
+ *
+ * A search with higher limits runs the same iterations and more, so its
+ * result answers requests with lower limits.
+ *
+ * @param cache The cache.
+ * @param key The position key.
+ * @param node_max The node limit of the request.
+ * @param depth_max The depth limit of the request.
+ * @param entry The result.
+ * @return A result was found.
+ */
+bool cache_lookup(cache *cache, uint64_t key, uint32_t node_max, uint8_t depth_max,
+                  cache_entry *entry);
+
+/**
+ * @brief Stores a result, unless the cache holds a deeper one.
+ *
+ * When all probed entries hold other positions, the shallowest is replaced.
+ */
+void cache_store(cache *cache, const cache_entry *entry);
+
+#endif
@@ -0,0 +1,650 @@
+/*
+ * mcu-max tools
+ * PGN reader and SAN move parser
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pgn.h"
+
+#define PGN_TOKEN_SIZE 32
+#define PGN_VALID_MOVES_NUM 256
+
+bool pgn_open(pgn_reader *reader, const char *path)
+{
+    reader->file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    reader->line = NULL;
+    reader->line_size = 0;
+    reader->line_pending = false;
+
+    return reader->file != NULL;
+}
+
+void pgn_close(pgn_reader *reader)
+{
+    if (reader->file && (reader->file != stdin))
+        fclose(reader->file);
+    reader->file = NULL;
+
+    free(reader->line);
+    reader->line = NULL;
+}
+
+static bool pgn_next_line(pgn_reader *reader)
+{
+    if (reader->line_pending)
+    {
+        reader->line_pending = false;
+
+        return true;
+    }
+
+    return getline(&reader->line, &reader->line_size, reader->file) != -1;
+}
+
+static bool pgn_parse_result(const char *token, pgn_result *result)
+{
+    if (!strcmp(token, "1-0"))
+        *result = PGN_RESULT_WHITE_WINS;
+    else if (!strcmp(token, "0-1"))
+        *result = PGN_RESULT_BLACK_WINS;
+    else if (!strcmp(token, "1/2-1/2"))
+        *result = PGN_RESULT_DRAW;
+    else if (!strcmp(token, "*"))
+        *result = PGN_RESULT_UNKNOWN;
+    else
+        return false;
+
+    return true;
+}
+
+// Parses a tag pair: [Name "Value"]
+static void pgn_read_tag(const char *line, pgn_game *game)
+{
+    const char *value_start = strchr(line, '"');
+    if (!value_start)
+        return;
+    value_start++;
+
+    const char *value_end = strrchr(value_start, '"');
+    if (!value_end)
+        return;
+
+    size_t value_size = value_end - value_start;
+
+    if (!strncmp(line, "[Result ", 8))
+    {
+        char token[PGN_TOKEN_SIZE];
+
+        if (value_size < sizeof(token))
+        {
+            memcpy(token, value_start, value_size);
+            token[value_size] = '\0';
+
+            pgn_parse_result(token, &game->result);
+        }
+    }
+    else if (!strncmp(line, "[FEN ", 5))
+    {
+        if (value_size < sizeof(game->fen))
+        {
+            memcpy(game->fen, value_start, value_size);
+            game->fen[value_size] = '\0';
+        }
+    }
+}
+
+bool pgn_read_game(pgn_reader *reader, pgn_game *game)
+{
+    bool has_content = false;
+    bool in_moves = false;
+    bool in_comment = false;
+    uint32_t variation_depth = 0;
+
+    game->fen[0] = '\0';
+    game->result = PGN_RESULT_UNKNOWN;
+    game->moves_num = 0;
+    game->truncated = false;
+
+    while (pgn_next_line(reader))
+    {
+        char *p = reader->line;
+
+        if (!in_comment && !variation_depth && (p[0] == '['))
+        {
+            // Tag of next game: this game had no result token
+            if (in_moves)
+            {
+                reader->line_pending = true;
+
+                return true;
+            }
+
+            pgn_read_tag(p, game);
+            has_content = true;
+
+            continue;
+        }
+
+        // Escape line
+        if (p[0] == '%')
+            continue;
+
+        while (*p)
+        {
+            char c = *p;
+
+            if (in_comment)
+            {
+                in_comment = (c != '}');
+                p++;
+            }
+            else if (c == '{')
+            {
+                in_comment = true;
+                p++;
+            }
+            else if (c == ';')
+                break;
+            else if (c == '(')
+            {
+                variation_depth++;
+                p++;
+            }
+            else if (c == ')')
+            {
+                if (variation_depth)
+                    variation_depth--;
+                p++;
+            }
+            else if (isspace((unsigned char)c))
+                p++;
+            else
+            {
+                char *token_start = p;
+                while (*p &&
+                       !isspace((unsigned char)*p) &&
+                       !strchr("{}();", *p))
+                    p++;
+
+                if (variation_depth)
+                    continue;
+
+                char token[PGN_TOKEN_SIZE];
+                size_t token_size = p - token_start;
+                if (token_size >= sizeof(token))
+                    token_size = sizeof(token) - 1;
+                memcpy(token, token_start, token_size);
+                token[token_size] = '\0';
+
+                in_moves = true;
+                has_content = true;
+
+                // NAG
+                if (token[0] == '$')
+                    continue;
+
+                pgn_result result;
+                if (pgn_parse_result(token, &result))
+                {
+                    game->result = result;
+
+                    return true;
+                }
+
+                // Skip move number
+                char *san = token;
+                while (isdigit((unsigned char)*san))
+                    san++;
+                while (*san == '.')
+                    san++;
+
+                if (*san)
+                {
+                    if (game->moves_num < PGN_MOVES_MAX)
+                    {
+                        strncpy(game->moves[game->moves_num], san, PGN_SAN_SIZE - 1);
+                        game->moves[game->moves_num][PGN_SAN_SIZE - 1] = '\0';
+                        game->moves_num++;
+                    }
+                    else
+                        game->truncated = true;
+                }
+            }
+        }
+    }
+
+    return has_content;
+}
+
+void pgn_set_start_position(const pgn_game *game)
+{
+    if (game->fen[0])
+        mcumax_set_fen_position(game->fen);
+    else
+        mcumax_init();
+}
+
+static mcumax_piece pgn_get_piece_type(char c)
+{
+    switch (c)
+    {
+    case 'N':
+        return MCUMAX_KNIGHT;
+
+    case 'B':
+        return MCUMAX_BISHOP;
+
+    case 'R':
+        return MCUMAX_ROOK;
+
+    case 'Q':
+        return MCUMAX_QUEEN;
+
+    case 'K':
+        return MCUMAX_KING;
+
+    default:
+        return MCUMAX_EMPTY;
+    }
+}
+
+// Checks if a piece of the side to move can reach a square, ignoring pins
+static bool pgn_is_reachable(mcumax_square from,
+                             mcumax_square to,
+                             mcumax_piece piece_type)
+{
+    static const int8_t knight_steps[] = {14, 18, 31, 33, -14, -18, -31, -33};
+    static const int8_t king_steps[] = {1, 15, 16, 17, -1, -15, -16, -17};
+
+    int32_t delta = to - from;
+
+    switch (piece_type)
+    {
+    case MCUMAX_PAWN_UPSTREAM:
+    {
+        bool is_white = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE);
+        int32_t forward = is_white ? -16 : 16;
+        bool is_empty = !mcumax.board[to];
+
+        if (delta == forward)
+            return is_empty;
+        if (delta == 2 * forward)
+            return is_empty &&
+                   !mcumax.board[from + forward] &&
+                   ((from >> 4) == (is_white ? 6 : 1));
+        if ((delta == forward - 1) || (delta == forward + 1))
+            return !is_empty || (to == mcumax.en_passant_square);
+
+        return false;
+    }
+
+    case MCUMAX_KNIGHT:
+    case MCUMAX_KING:
+    {
+        const int8_t *steps = (piece_type == MCUMAX_KNIGHT) ? knight_steps : king_steps;
+
+        for (uint32_t i = 0; i < 8; i++)
+            if (delta == steps[i])
+                return true;
+
+        return false;
+    }
+
+    default:
+    {
+        bool is_straight = ((delta & 0xf) == 0) || ((from >> 4) == (to >> 4));
+        bool is_diagonal = !is_straight &&
+                           (((delta % 15) == 0) || ((delta % 17) == 0));
+
+        if (!(is_straight && (piece_type != MCUMAX_BISHOP)) &&
+            !(is_diagonal && (piece_type != MCUMAX_ROOK)))
+            return false;
+
+        // Walk the ray, which must stay on the board
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            int32_t step = king_steps[i];
+            if ((delta % step) || ((delta / step) <= 0))
+                continue;
+
+            mcumax_square square = from;
+            while (!((square += step) & 0x88))
+            {
+                if (square == to)
+                    return true;
+                if (mcumax.board[square])
+                    break;
+            }
+        }
+
+        return false;
+    }
+    }
+}
+
+bool pgn_parse_san(const char *san, mcumax_move *move)
+{
+    // Strip capture, check and annotation symbols
+    char s[PGN_SAN_SIZE];
+    uint32_t s_size = 0;
+    uint32_t castling_size = 0;
+
+    for (; *san && (s_size < (PGN_SAN_SIZE - 1)); san++)
+    {
+        if ((*san == 'O') || (*san == '0'))
+            castling_size++;
+        else if (!strchr("x=+#!?-", *san))
+            s[s_size++] = *san;
+    }
+    s[s_size] = '\0';
+
+    mcumax_square home_row = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE) ? 0x70 : 0x00;
+
+    mcumax_piece piece_type = MCUMAX_PAWN_UPSTREAM;
+    mcumax_square square_to;
+    int32_t from_file = -1;
+    int32_t from_rank = -1;
+
+    if (castling_size)
+    {
+        if (s_size || (castling_size > 3))
+            return false;
+
+        piece_type = MCUMAX_KING;
+        from_file = 4;
+        square_to = home_row | ((castling_size == 2) ? 6 : 2);
+    }
+    else
+    {
+        char *p = s;
+
+        if (pgn_get_piece_type(*p))
+            piece_type = pgn_get_piece_type(*p++);
+
+        size_t p_size = strlen(p);
+
+        // Promotion: the engine only promotes to queen
+        if (p_size && pgn_get_piece_type(p[p_size - 1]))
+        {
+            if ((piece_type != MCUMAX_PAWN_UPSTREAM) ||
+                (p[p_size - 1] != 'Q'))
+                return false;
+
+            p[--p_size] = '\0';
+        }
+
+        if (p_size < 2)
+            return false;
+
+        uint32_t to_file = p[p_size - 2] - 'a';
+        uint32_t to_rank = p[p_size - 1] - '1';
+        if ((to_file > 7) || (to_rank > 7))
+            return false;
+
+        square_to = 0x10 * (7 - to_rank) + to_file;
+
+        // Disambiguation
+        for (size_t i = 0; i < p_size - 2; i++)
+        {
+            if ((p[i] >= 'a') && (p[i] <= 'h'))
+                from_file = p[i] - 'a';
+            else if ((p[i] >= '1') && (p[i] <= '8'))
+                from_rank = p[i] - '1';
+            else
+                return false;
+        }
+    }
+
+    // Fast path: a single piece reaches the square
+    if (!castling_size)
+    {
+        uint8_t side = mcumax_get_current_side();
+        uint32_t candidates_num = 0;
+
+        for (mcumax_square square = 0; square < 0x80; square = (square + 9) & ~0x08)
+        {
+            uint8_t raw_piece = mcumax.board[square];
+            mcumax_piece square_piece_type = raw_piece & 0x7;
+            if (square_piece_type == MCUMAX_PAWN_DOWNSTREAM)
+                square_piece_type = MCUMAX_PAWN_UPSTREAM;
+
+            if (!(raw_piece & side) ||
+                (square_piece_type != piece_type) ||
+                ((from_file >= 0) && ((square & 0x7) != from_file)) ||
+                ((from_rank >= 0) && ((7 - (square >> 4)) != from_rank)) ||
+                !pgn_is_reachable(square, square_to, piece_type))
+                continue;
+
+            move->from = square;
+            move->to = square_to;
+            candidates_num++;
+        }
+
+        if (candidates_num <= 1)
+            return candidates_num == 1;
+    }
+
+    // Several candidates: only legal moves
+    mcumax_move valid_moves[PGN_VALID_MOVES_NUM];
+    uint32_t valid_moves_num = mcumax_search_valid_moves(valid_moves, PGN_VALID_MOVES_NUM);
+    uint32_t matches_num = 0;
+
+    for (uint32_t i = 0; i < valid_moves_num; i++)
+    {
+        mcumax_move valid_move = valid_moves[i];
+
+        if (valid_move.to != square_to)
+            continue;
+
+        mcumax_piece valid_piece_type = mcumax_get_piece(valid_move.from) & 0x7;
+        if (valid_piece_type == MCUMAX_PAWN_DOWNSTREAM)
+            valid_piece_type = MCUMAX_PAWN_UPSTREAM;
+
+        if ((valid_piece_type != piece_type) ||
+            ((from_file >= 0) && ((valid_move.from & 0x7) != from_file)) ||
+            ((from_rank >= 0) && ((7 - (valid_move.from >> 4)) != from_rank)))
+            continue;
+
+        // Castling is a two-square king move from its home square
+        if (castling_size && (valid_move.from != (home_row | 4)))
+            continue;
+
+        *move = valid_move;
+        matches_num++;
+    }
+
+    return matches_num == 1;
+}
+
+void pgn_move_to_san(mcumax_move move, char *s)
+{
+    mcumax_piece piece_type = mcumax_get_piece(move.from) & 0x7;
+    bool is_capture = ((mcumax_get_piece(move.to) & 0x7) != MCUMAX_EMPTY);
+    bool is_castling = (piece_type == MCUMAX_KING) &&
+                       (((move.to & 0x7) == (move.from & 0x7) + 2) ||
+                        ((move.to & 0x7) + 2 == (move.from & 0x7)));
+    char *p = s;
+
+    if (is_castling)
+    {
+        strcpy(p, ((move.to & 0x7) > (move.from & 0x7)) ? "O-O" : "O-O-O");
+        p += strlen(p);
+    }
+    else if (piece_type <= MCUMAX_PAWN_DOWNSTREAM)
+    {
+        // Diagonal pawn moves are captures, including en passant
+        if ((move.to & 0x7) != (move.from & 0x7))
+        {
+            *p++ = 'a' + (move.from & 0x7);
+            is_capture = true;
+        }
+        else
+            is_capture = false;
+    }
+    else
+    {
+        *p++ = " PPNKBRQ"[piece_type];
+
+        // Disambiguation
+        mcumax_move valid_moves[PGN_VALID_MOVES_NUM];
+        uint32_t valid_moves_num = mcumax_search_valid_moves(valid_moves, PGN_VALID_MOVES_NUM);
+        bool is_ambiguous = false;
+        bool is_file_ambiguous = false;
+        bool is_rank_ambiguous = false;
+
+        for (uint32_t i = 0; i < valid_moves_num; i++)
+        {
+            mcumax_move valid_move = valid_moves[i];
+
+            if ((valid_move.to != move.to) ||
+                (valid_move.from == move.from) ||
+                ((mcumax_get_piece(valid_move.from) & 0x7) != piece_type))
+                continue;
+
+            is_ambiguous = true;
+            if ((valid_move.from & 0x7) == (move.from & 0x7))
+                is_file_ambiguous = true;
+            if ((valid_move.from >> 4) == (move.from >> 4))
+                is_rank_ambiguous = true;
+        }
+
+        if (is_ambiguous && (!is_file_ambiguous || is_rank_ambiguous))
+            *p++ = 'a' + (move.from & 0x7);
+        if (is_file_ambiguous)
+            *p++ = '1' + 7 - (move.from >> 4);
+    }
+
+    if (!is_castling)
+    {
+        if (is_capture)
+            *p++ = 'x';
+        *p++ = 'a' + (move.to & 0x7);
+        *p++ = '1' + 7 - (move.to >> 4);
+
+        if ((piece_type <= MCUMAX_PAWN_DOWNSTREAM) &&
+            (((move.to >> 4) == 0) || ((move.to >> 4) == 7)))
+        {
+            *p++ = '=';
+            *p++ = 'Q';
+        }
+        *p = '\0';
+    }
+
+    // Check and checkmate
+    mcumax_struct state = mcumax;
+
+    if (mcumax_play_move(move))
+    {
+        uint8_t side = mcumax_get_current_side();
+
+        if (mcumax_is_in_check(side))
+        {
+            mcumax_move valid_move;
+            *p++ = mcumax_search_valid_moves(&valid_move, 1) ? '+' : '#';
+            *p = '\0';
+        }
+    }
+
+    mcumax = state;
+}
+
+bool pgn_write_game(FILE *file, const pgn_game *game)
+{
+    static const char *const results[] = {"*", "1-0", "0-1", "1/2-1/2"};
+
+    const char *result = results[game->result];
+
+    fprintf(file, "[Result \"%s\"]\n", result);
+    if (game->fen[0])
+        fprintf(file, "[SetUp \"1\"]\n[FEN \"%s\"]\n", game->fen);
+    fputc('\n', file);
+
+    // Move numbers follow the side to move of the start position
+    pgn_set_start_position(game);
+    bool is_white = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE);
+    unsigned int move_number = 1;
+
+    if ((sscanf(game->fen, "%*s %*s %*s %*s %*s %u", &move_number) != 1) ||
+        !move_number)
+        move_number = 1;
+
+    uint32_t line_size = 0;
+
+    for (uint32_t i = 0; i < game->moves_num; i++)
+    {
+        char token[PGN_TOKEN_SIZE];
+
+        if (is_white)
+            snprintf(token, sizeof(token), "%u. %s", move_number, game->moves[i]);
+        else if (!i)
+            snprintf(token, sizeof(token), "%u... %s", move_number, game->moves[i]);
+        else
+            snprintf(token, sizeof(token), "%s", game->moves[i]);
+
+        size_t token_size = strlen(token);
+        if (line_size && (line_size + 1 + token_size > 79))
+        {
+            fputc('\n', file);
+            line_size = 0;
+        }
+        else if (line_size)
+        {
+            fputc(' ', file);
+            line_size++;
+        }
+
+        fputs(token, file);
+        line_size += token_size;
+
+        if (!is_white)
+            move_number++;
+        is_white = !is_white;
+    }
+
+    if (line_size && (line_size + 1 + strlen(result) > 79))
+        fputc('\n', file);
+    else if (line_size)
+        fputc(' ', file);
+
+    return fprintf(file, "%s\n\n", result) > 0;
+}
+
+void pgn_move_to_uci(mcumax_move move, char *s)
+{
+    s[0] = 'a' + (move.from & 0x07);
+    s[1] = '1' + 7 - ((move.from & 0x70) >> 4);
+    s[2] = 'a' + (move.to & 0x07);
+    s[3] = '1' + 7 - ((move.to & 0x70) >> 4);
+    s[4] = '\0';
+}
+
+static mcumax_square pgn_uci_to_square(const char *s)
+{
+    mcumax_square file = s[0] - 'a';
+    mcumax_square rank = s[1] - '1';
+
+    if ((file > 7) || (rank > 7))
+        return MCUMAX_SQUARE_INVALID;
+
+    return 0x10 * (7 - rank) + file;
+}
+
+mcumax_move pgn_uci_to_move(const char *s)
+{
+    if (strlen(s) < 4)
+        return MCUMAX_MOVE_INVALID;
+
+    mcumax_move move = {pgn_uci_to_square(s), pgn_uci_to_square(s + 2)};
+    if ((move.from == MCUMAX_SQUARE_INVALID) ||
+        (move.to == MCUMAX_SQUARE_INVALID))
+        return MCUMAX_MOVE_INVALID;
+
+    return move;
+}
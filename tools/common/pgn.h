@@ -0,0 +1,123 @@
+/*
+ * mcu-max tools
+ * PGN reader and SAN move parser
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(PGN_H)
+#define PGN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mcu-max.h"
+
+#define PGN_MOVES_MAX 1024
+#define PGN_SAN_SIZE 12
+#define PGN_FEN_SIZE 128
+
+typedef enum
+{
+    PGN_RESULT_UNKNOWN,
+    PGN_RESULT_WHITE_WINS,
+    PGN_RESULT_BLACK_WINS,
+    PGN_RESULT_DRAW,
+} pgn_result;
+
+typedef struct
+{
+    char fen[PGN_FEN_SIZE];
+    pgn_result result;
+    uint32_t moves_num;
+    char moves[PGN_MOVES_MAX][PGN_SAN_SIZE];
+    bool truncated;
+} pgn_game;
+
+typedef struct
+{
+    FILE *file;
+    char *line;
+    size_t line_size;
+    bool line_pending;
+} pgn_reader;
+
+/**
+ * @brief Opens a PGN file for streaming.
+ *
+ * @param reader The reader.
+ * @param path The file path, "-" for stdin.
+ * @return The file was opened.
+ */
+bool pgn_open(pgn_reader *reader, const char *path);
+
+/**
+ * @brief Closes a PGN file.
+ */
+void pgn_close(pgn_reader *reader);
+
+/**
+ * @brief Reads the next game. Comments, variations and NAGs are skipped.
+ *
+ * Moves beyond PGN_MOVES_MAX are dropped and the game is marked truncated.
+ *
+ * @param reader The reader.
+ * @param game The game.
+ * @return A game was read.
+ */
+bool pgn_read_game(pgn_reader *reader, pgn_game *game);
+
+/**
+ * @brief Sets the engine to the game's start position.
+ */
+void pgn_set_start_position(const pgn_game *game);
+
+/**
+ * @brief Resolves a SAN move in the engine's current position.
+ *
+ * Underpromotions are not supported by the engine and are rejected.
+ * If a single piece can reach the target square, the move is returned
+ * without checking for pins: mcumax_play_move() then rejects illegal moves.
+ *
+ * @param san The SAN move.
+ * @param move The resolved move.
+ * @return The move is valid.
+ */
+bool pgn_parse_san(const char *san, mcumax_move *move);
+
+/**
+ * @brief Converts a valid move of the engine's current position to SAN.
+ *
+ * @param move The move.
+ * @param s A buffer of at least PGN_SAN_SIZE characters.
+ */
+void pgn_move_to_san(mcumax_move move, char *s);
+
+/**
+ * @brief Writes a game with its Result and FEN tags.
+ *
+ * @param file The file.
+ * @param game The game.
+ * @return The game was written.
+ */
+bool pgn_write_game(FILE *file, const pgn_game *game);
+
+/**
+ * @brief Converts a move to UCI notation (e.g. e2e4).
+ *
+ * @param move The move.
+ * @param s A buffer of at least 5 characters.
+ */
+void pgn_move_to_uci(mcumax_move move, char *s);
+
+/**
+ * @brief Converts a move in UCI notation to a move.
+ *
+ * @return The move (MCUMAX_MOVE_INVALID if invalid).
+ */
+mcumax_move pgn_uci_to_move(const char *s);
+
+#endif
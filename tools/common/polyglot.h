@@ -0,0 +1,79 @@
+/*
+ * mcu-max tools
+ * Polyglot position keys and book entries
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(POLYGLOT_H)
+#define POLYGLOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "mcu-max.h"
+
+#define POLYGLOT_RANDOM_NUM 781
+#define POLYGLOT_ENTRY_SIZE 16
+
+typedef struct
+{
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+    uint32_t learn;
+} polyglot_entry;
+
+/**
+ * @brief Loads a Polyglot Random64 table, replacing the built-in one.
+ *
+ * Keys use Polyglot's Random64[] by default. The file must hold the 781 numbers of Polyglot's Random64[] array as
+ * hexadecimal numbers, in order. Any other text (C syntax, comments) is
+ * ignored, so the array can be pasted from the Polyglot sources as is.
+ *
+ * @param path The file path.
+ * @return The table was loaded.
+ */
+bool polyglot_load_random(const char *path);
+
+/**
+ * @brief Replaces the built-in table with one that is not Polyglot-compatible.
+ *
+ * Keys are then only consistent within these tools, which is enough for
+ * caches and indices.
+ *
+ * @param seed The random seed.
+ */
+void polyglot_init_random(uint64_t seed);
+
+/**
+ * @brief Checks the random table against the specification's start key.
+ *
+ * The built-in table passes it; a table loaded with polyglot_load_random()
+ * that fails it is not Polyglot's Random64[]. Resets the engine to the start position.
+ *
+ * @return The start position has the standard Polyglot key.
+ */
+bool polyglot_check_random(void);
+
+/**
+ * @brief Returns the key of the engine's current position.
+ */
+uint64_t polyglot_get_key(void);
+
+/**
+ * @brief Encodes a move of the engine's current position as a Polyglot move.
+ */
+uint16_t polyglot_encode_move(mcumax_move move);
+
+/**
+ * @brief Writes a big-endian Polyglot book entry.
+ *
+ * @return The entry was written.
+ */
+bool polyglot_write_entry(FILE *file, const polyglot_entry *entry);
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * mcu-max tools
+ * Tactical puzzle mining
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "puzzle.h"
+
+#define PUZZLE_MOVES_MAX 256
+
+// Engine capture values (see mcu-max.c), indexed by piece type
+static const int32_t puzzle_piece_values[] = {
+    0, 74, 74, 259, 0, 296, 444, 851};
+
+// Returns white's material minus black's material
+static int32_t puzzle_get_material(void)
+{
+    int32_t material = 0;
+
+    for (mcumax_square rank = 0; rank < 8; rank++)
+    {
+        for (mcumax_square file = 0; file < 8; file++)
+        {
+            mcumax_piece piece = mcumax_get_piece(16 * rank + file);
+            int32_t value = puzzle_piece_values[piece & 0b111];
+
+            material += (piece & MCUMAX_BLACK) ? -value : value;
+        }
+    }
+
+    return material;
+}
+
+// Searches the engine's position; mates and stalemates need no search
+static int32_t puzzle_search(uint32_t node_max, uint32_t depth_max,
+                             puzzle_game *result, mcumax_move *best_move)
+{
+    *best_move = MCUMAX_MOVE_INVALID;
+
+    if (!mcumax_search_valid_moves(NULL, 0))
+        return mcumax_is_in_check(mcumax_get_current_side())
+                   ? -PUZZLE_SCORE_MATE
+                   : 0;
+
+    *best_move = mcumax_search_best_move(node_max, depth_max);
+
+    result->searches_num++;
+    result->nodes_num += mcumax.node_count;
+
+    return mcumax.search_score;
+}
+
+// Returns the best gain of the moves other than the best move, stopping
+// as soon as one reaches PUZZLE_SECOND_GAIN_MAX
+static int32_t puzzle_get_second_gain(const mcumax_struct *snapshot, mcumax_move best_move,
+                                      int32_t base, const puzzle_limits *limits,
+                                      puzzle_game *result)
+{
+    mcumax_move moves[PUZZLE_MOVES_MAX];
+    int32_t second_gain = -PUZZLE_SCORE_MATE;
+
+    mcumax = *snapshot;
+    uint32_t moves_num = mcumax_search_valid_moves(moves, PUZZLE_MOVES_MAX);
+
+    // A forced move is no puzzle
+    if (moves_num < 2)
+        return PUZZLE_SCORE_MATE;
+
+    for (uint32_t i = 0; i < moves_num; i++)
+    {
+        mcumax_move move;
+
+        if ((moves[i].from == best_move.from) &&
+            (moves[i].to == best_move.to))
+            continue;
+
+        mcumax = *snapshot;
+        mcumax_play_move(moves[i]);
+
+        int32_t gain = -puzzle_search(limits->second_node_max, limits->depth_max,
+                                      result, &move) -
+                       base;
+        if (gain > second_gain)
+            second_gain = gain;
+
+        if (second_gain >= PUZZLE_SECOND_GAIN_MAX)
+            break;
+    }
+
+    return second_gain;
+}
+
+// Sets the solution line: the best move, then the engine's best moves
+static void puzzle_set_line(const mcumax_struct *snapshot, mcumax_move best_move,
+                            const puzzle_limits *limits, puzzle_game *result,
+                            puzzle *puzzle)
+{
+    uint32_t line_plies = (limits->line_plies < PUZZLE_LINE_MAX)
+                              ? limits->line_plies
+                              : PUZZLE_LINE_MAX;
+
+    mcumax = *snapshot;
+    mcumax_get_fen(puzzle->fen, PGN_FEN_SIZE);
+
+    puzzle->line[0] = best_move;
+    puzzle->line_num = 1;
+    mcumax_play_move(best_move);
+
+    while (puzzle->line_num < line_plies)
+    {
+        mcumax_move move;
+
+        puzzle_search(limits->node_max, limits->depth_max, result, &move);
+        if (move.from == MCUMAX_SQUARE_INVALID)
+            break;
+
+        puzzle->line[puzzle->line_num++] = move;
+        mcumax_play_move(move);
+    }
+}
+
+bool puzzle_mine_game(const pgn_game *game, const puzzle_limits *limits,
+                      puzzle_game *result)
+{
+    mcumax_struct *snapshots = malloc((PGN_MOVES_MAX + 1) * sizeof(mcumax_struct));
+    int32_t *materials = malloc((PGN_MOVES_MAX + 1) * sizeof(int32_t));
+    bool *checks = malloc(PGN_MOVES_MAX * sizeof(bool));
+    if (!snapshots || !materials || !checks)
+    {
+        free(snapshots);
+        free(materials);
+        free(checks);
+
+        return false;
+    }
+
+    memset(result, 0, sizeof(*result));
+
+    // Replay: engine snapshots, material and checks per ply
+    pgn_set_start_position(game);
+
+    uint32_t plies_num = 0;
+
+    for (; plies_num < game->moves_num; plies_num++)
+    {
+        mcumax_move move;
+
+        snapshots[plies_num] = mcumax;
+        materials[plies_num] = puzzle_get_material();
+
+        if (!pgn_parse_san(game->moves[plies_num], &move) ||
+            !mcumax_play_move(move))
+        {
+            mcumax = snapshots[plies_num];
+
+            break;
+        }
+
+        checks[plies_num] = mcumax_is_in_check(mcumax_get_current_side());
+    }
+
+    snapshots[plies_num] = mcumax;
+    materials[plies_num] = puzzle_get_material();
+
+    // A mate ends the game with the largest swing
+    if (!mcumax_search_valid_moves(NULL, 0) &&
+        mcumax_is_in_check(mcumax_get_current_side()))
+        materials[plies_num] = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE)
+                                   ? -PUZZLE_SCORE_MATE
+                                   : PUZZLE_SCORE_MATE;
+
+    result->plies_num = plies_num;
+
+    for (uint32_t i = 0;
+         (i < plies_num) && (result->puzzles_num < PUZZLE_GAME_PUZZLES_MAX);
+         i++)
+    {
+        mcumax = snapshots[i];
+
+        int32_t sign = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE) ? 1 : -1;
+        uint32_t end = (i + PUZZLE_SWING_PLIES < plies_num)
+                           ? i + PUZZLE_SWING_PLIES
+                           : plies_num;
+        int32_t swing = sign * (materials[end] - materials[i]);
+
+        if (swing < (checks[i] ? PUZZLE_SWING_CHECK_MIN : PUZZLE_SWING_MIN))
+            continue;
+
+        result->candidates_num++;
+
+        // Search scores start at 0 in the game's start position
+        int32_t base = sign * (materials[i] - materials[0]);
+        mcumax_move best_move;
+
+        int32_t gain = puzzle_search(limits->node_max, limits->depth_max,
+                                     result, &best_move) -
+                       base;
+        if ((best_move.from == MCUMAX_SQUARE_INVALID) ||
+            (gain < PUZZLE_GAIN_MIN))
+            continue;
+
+        int32_t second_gain = puzzle_get_second_gain(&snapshots[i], best_move,
+                                                     base, limits, result);
+        if (second_gain >= PUZZLE_SECOND_GAIN_MAX)
+            continue;
+
+        puzzle *puzzle = &result->puzzles[result->puzzles_num++];
+
+        puzzle->ply = i;
+        puzzle->gain = gain;
+        puzzle->second_gain = second_gain;
+        puzzle_set_line(&snapshots[i], best_move, limits, result, puzzle);
+
+        // The next plies of the game usually play out the same tactic
+        i += puzzle->line_num - 1;
+    }
+
+    free(snapshots);
+    free(materials);
+    free(checks);
+
+    return plies_num == game->moves_num;
+}
@@ -0,0 +1,86 @@
+/*
+ * mcu-max tools
+ * Tactical puzzle mining
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(PUZZLE_H)
+#define PUZZLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mcu-max.h"
+#include "pgn.h"
+
+// Scores are in engine units (a pawn is about 74), for the side to move
+#define PUZZLE_SCORE_MATE 8000
+
+// Filter: material won by the side to move within the next plies of the
+// game; a check by the played move lowers the threshold
+#define PUZZLE_SWING_PLIES 4
+#define PUZZLE_SWING_MIN 222
+#define PUZZLE_SWING_CHECK_MIN 74
+
+// Search: the best move must win this much over the current material...
+#define PUZZLE_GAIN_MIN 148
+// ...while the second best move may not win this much
+#define PUZZLE_SECOND_GAIN_MAX 74
+
+#define PUZZLE_LINE_MAX 16
+#define PUZZLE_GAME_PUZZLES_MAX 16
+
+typedef struct
+{
+    uint32_t node_max;
+    uint32_t second_node_max;
+    uint32_t depth_max;
+    uint32_t line_plies;
+} puzzle_limits;
+
+typedef struct
+{
+    char fen[PGN_FEN_SIZE];
+    uint32_t ply;
+
+    uint32_t line_num;
+    mcumax_move line[PUZZLE_LINE_MAX];
+
+    int32_t gain;
+    int32_t second_gain;
+} puzzle;
+
+typedef struct
+{
+    uint32_t plies_num;
+    uint32_t candidates_num;
+    uint32_t searches_num;
+    uint64_t nodes_num;
+
+    uint32_t puzzles_num;
+    puzzle puzzles[PUZZLE_GAME_PUZZLES_MAX];
+} puzzle_game;
+
+/**
+ * @brief Mines the puzzles of a game: positions where exactly one move wins.
+ *
+ * Plies pass a cheap filter first: the game itself must show a material
+ * swing for the side to move. Candidates are then searched for the best
+ * move, and each other move is searched until one also wins, so only
+ * unique solutions pay for a full two-best-lines search.
+ *
+ * Gains are measured against the material of the position, relative to the
+ * game's start position (mcumax scores start at 0 there).
+ *
+ * @param game The game; it is mined up to the first invalid move.
+ * @param limits The search limits.
+ * @param result The puzzles and statistics.
+ * @return The game could be replayed.
+ */
+bool puzzle_mine_game(const pgn_game *game, const puzzle_limits *limits,
+                      puzzle_game *result);
+
+#endif
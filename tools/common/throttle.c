@@ -0,0 +1,80 @@
+/*
+ * mcu-max tools
+ * Nodes-per-second throttle
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+
+#include "throttle.h"
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static void throttle_check(void *userdata)
+{
+    throttle *throttle = userdata;
+
+    if (mcumax.node_count < throttle->next_node_count)
+        return;
+
+    throttle->next_node_count = mcumax.node_count + throttle->quantum;
+
+    double delay = throttle->start_time +
+                   (double)mcumax.node_count / throttle->nps_max -
+                   get_time();
+
+    if (delay >= THROTTLE_SLEEP_MIN)
+    {
+        struct timespec ts;
+
+        ts.tv_sec = (time_t)delay;
+        ts.tv_nsec = (long)(1E9 * (delay - ts.tv_sec));
+        nanosleep(&ts, NULL);
+
+        throttle->sleep_time += delay;
+        throttle->sleeps_num++;
+    }
+    else if (delay > 0)
+    {
+        sched_yield();
+
+        throttle->yields_num++;
+    }
+}
+
+void throttle_init(throttle *throttle, uint32_t nps_max)
+{
+    memset(throttle, 0, sizeof(*throttle));
+
+    throttle->nps_max = nps_max;
+    throttle->quantum = nps_max / THROTTLE_QUANTA_PER_SECOND;
+    if (throttle->quantum < THROTTLE_QUANTUM_MIN)
+        throttle->quantum = THROTTLE_QUANTUM_MIN;
+}
+
+void throttle_start(throttle *throttle)
+{
+    if (!throttle->nps_max)
+    {
+        mcumax_set_callback(NULL, NULL);
+
+        return;
+    }
+
+    // Node counts restart with each search
+    throttle->start_time = get_time();
+    throttle->next_node_count = throttle->quantum;
+
+    mcumax_set_callback(throttle_check, throttle);
+}
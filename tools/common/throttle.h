@@ -0,0 +1,57 @@
+/*
+ * mcu-max tools
+ * Nodes-per-second throttle
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(THROTTLE_H)
+#define THROTTLE_H
+
+#include <stdint.h>
+
+#include "mcu-max.h"
+
+// Pacing granularity: the clock is read this often per second of search
+#define THROTTLE_QUANTA_PER_SECOND 100
+#define THROTTLE_QUANTUM_MIN 16
+
+// Shorter delays yield the CPU instead of sleeping
+#define THROTTLE_SLEEP_MIN 0.0005
+
+typedef struct
+{
+    uint32_t nps_max;
+    uint32_t quantum;
+
+    double start_time;
+    uint32_t next_node_count;
+
+    double sleep_time;
+    uint64_t sleeps_num;
+    uint64_t yields_num;
+} throttle;
+
+/**
+ * @brief Initializes a throttle.
+ *
+ * @param throttle The throttle.
+ * @param nps_max The nodes per second; 0 for none.
+ */
+void throttle_init(throttle *throttle, uint32_t nps_max);
+
+/**
+ * @brief Starts throttling the next search of the calling thread's engine.
+ *
+ * Installs the throttle as the engine callback. Every quantum of nodes, the
+ * search sleeps (or yields, for short delays) until it is back on its
+ * nodes-per-second schedule, so a throttled engine takes a predictable CPU
+ * share instead of spinning at full speed.
+ *
+ * @param throttle The throttle.
+ */
+void throttle_start(throttle *throttle);
+
+#endif
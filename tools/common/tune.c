@@ -0,0 +1,179 @@
+/*
+ * mcu-max tools
+ * Self-play for search parameter tuning
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "tune.h"
+
+#define TUNE_MOVES_MAX 256
+
+// Ranges keep every parameter within sane search behaviour
+const tune_param tune_params[] = {
+    {"null_move_reduction", "MCUMAX_NULL_MOVE_REDUCTION",
+     offsetof(mcumax_params, null_move_reduction), 1, 5, 1},
+    {"null_move_material", "MCUMAX_NULL_MOVE_MATERIAL",
+     offsetof(mcumax_params, null_move_material), 15, 60, 4},
+    {"reduction_depth", "MCUMAX_REDUCTION_DEPTH",
+     offsetof(mcumax_params, reduction_depth), 2, 9, 1},
+    {"check_extension_material", "MCUMAX_CHECK_EXTENSION_MATERIAL",
+     offsetof(mcumax_params, check_extension_material), 10, 60, 4},
+    {"king_freeze_material", "MCUMAX_KING_FREEZE_MATERIAL",
+     offsetof(mcumax_params, king_freeze_material), 10, 60, 4},
+    {"king_freeze_penalty", "MCUMAX_KING_FREEZE_PENALTY",
+     offsetof(mcumax_params, king_freeze_penalty), 0, 80, 6},
+#ifdef MCUMAX_PROBCUT_ENABLED
+    {"probcut_margin", "MCUMAX_PROBCUT_MARGIN",
+     offsetof(mcumax_params, probcut_margin), 20, 400, 20},
+#endif
+#ifdef MCUMAX_LAZY_EVAL_ENABLED
+    {"lazy_eval_margin", "MCUMAX_LAZY_EVAL_MARGIN",
+     offsetof(mcumax_params, lazy_eval_margin), 50, 800, 40},
+#endif
+};
+
+const uint32_t tune_params_num = sizeof(tune_params) / sizeof(tune_params[0]);
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+// xorshift64*
+static uint64_t tune_get_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+// At the deadline, ends the search after the current iteration like the
+// node limit does (a stopped search returns no move); the clock is read
+// every 1024 nodes
+static void tune_check_time(void *userdata)
+{
+    if (!(mcumax.node_count & 0x3ff) &&
+        (get_time() >= *(double *)userdata))
+        mcumax.node_max = 0;
+}
+
+int32_t tune_get_param(const mcumax_params *params, uint32_t index)
+{
+    int32_t value;
+
+    memcpy(&value, (const uint8_t *)params + tune_params[index].offset, sizeof(value));
+
+    return value;
+}
+
+void tune_set_param(mcumax_params *params, uint32_t index, int32_t value)
+{
+    const tune_param *param = &tune_params[index];
+
+    if (value < param->min)
+        value = param->min;
+    if (value > param->max)
+        value = param->max;
+
+    memcpy((uint8_t *)params + param->offset, &value, sizeof(value));
+}
+
+bool tune_set_opening(uint64_t seed, uint32_t plies)
+{
+    mcumax_move moves[TUNE_MOVES_MAX];
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+
+    mcumax_init();
+
+    for (uint32_t i = 0; i < plies; i++)
+    {
+        uint32_t moves_num = mcumax_search_valid_moves(moves, TUNE_MOVES_MAX);
+        if (!moves_num)
+            return false;
+
+        mcumax_play_move(moves[tune_get_random(&state) % moves_num]);
+    }
+
+    return mcumax_search_valid_moves(NULL, 0) != 0;
+}
+
+void tune_play_game(const mcumax_params *white, const mcumax_params *black,
+                    const tune_limits *limits, tune_game *game)
+{
+    double deadline;
+    uint32_t node_max = limits->time_max ? UINT32_MAX : limits->node_max;
+    uint32_t fifty_plies = 0;
+    uint32_t adjudicate_plies = 0;
+    int32_t adjudicate_sign = 0;
+
+    memset(game, 0, sizeof(*game));
+
+    for (; game->plies_num < TUNE_PLIES_MAX; game->plies_num++)
+    {
+        bool is_white = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE);
+        int32_t sign = is_white ? 1 : -1;
+
+        if (!mcumax_search_valid_moves(NULL, 0))
+        {
+            if (mcumax_is_in_check(mcumax_get_current_side()))
+                game->result = -sign;
+
+            break;
+        }
+
+        if (fifty_plies >= TUNE_FIFTY_PLIES)
+            break;
+
+        mcumax_set_params(is_white ? white : black);
+        deadline = get_time() + 1E-3 * limits->time_max;
+
+        mcumax_set_callback(limits->time_max ? tune_check_time : NULL, &deadline);
+        mcumax_move move = mcumax_search_best_move(node_max, limits->depth_max);
+        mcumax_set_callback(NULL, NULL);
+        game->nodes_num += mcumax.node_count;
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+        game->skips_num += mcumax.iteration_skip_count;
+        game->skip_nodes_num += mcumax.iteration_skip_nodes;
+#endif
+        if (move.from == MCUMAX_SQUARE_INVALID)
+            break;
+
+        // Scores start at 0 in the (balanced) start position
+        int32_t score = sign * mcumax.search_score;
+        int32_t score_sign = (score >= TUNE_ADJUDICATE_SCORE)
+                                 ? 1
+                                 : (score <= -TUNE_ADJUDICATE_SCORE) ? -1 : 0;
+        if (score_sign && (score_sign == adjudicate_sign))
+            adjudicate_plies++;
+        else
+            adjudicate_plies = (score_sign != 0);
+        adjudicate_sign = score_sign;
+
+        if (adjudicate_plies >= TUNE_ADJUDICATE_PLIES)
+        {
+            game->result = adjudicate_sign;
+
+            break;
+        }
+
+        mcumax_piece piece = mcumax_get_piece(move.from) & 0b111;
+        mcumax_piece captured = mcumax_get_piece(move.to) & 0b111;
+        bool is_pawn = (piece == MCUMAX_PAWN_UPSTREAM) ||
+                       (piece == MCUMAX_PAWN_DOWNSTREAM);
+
+        fifty_plies = (is_pawn || (captured != MCUMAX_EMPTY)) ? 0 : fifty_plies + 1;
+
+        mcumax_play_move(move);
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ * mcu-max tools
+ * Self-play for search parameter tuning
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#if !defined(TUNE_H)
+#define TUNE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mcu-max.h"
+
+// Game end: ply limit and fifty-move rule (no repetition detection)
+#define TUNE_PLIES_MAX 400
+#define TUNE_FIFTY_PLIES 100
+
+// Adjudication: both engines agree on this score for this many plies
+#define TUNE_ADJUDICATE_SCORE 1000
+#define TUNE_ADJUDICATE_PLIES 8
+
+typedef struct
+{
+    const char *name;
+    const char *macro;
+    size_t offset;
+    int32_t min;
+    int32_t max;
+    // Initial SPSA perturbation
+    double step;
+} tune_param;
+
+extern const tune_param tune_params[];
+extern const uint32_t tune_params_num;
+
+typedef struct
+{
+    uint32_t node_max;
+    uint32_t depth_max;
+    // Milliseconds per move; 0 for a fixed node budget
+    uint32_t time_max;
+    uint32_t opening_plies;
+} tune_limits;
+
+typedef struct
+{
+    // 1: white wins, 0: draw, -1: black wins
+    int32_t result;
+    uint32_t plies_num;
+    uint64_t nodes_num;
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    // Root iterations not started, and their predicted nodes
+    uint64_t skips_num;
+    uint64_t skip_nodes_num;
+#endif
+} tune_game;
+
+/**
+ * @brief Gets a parameter of a parameter block.
+ */
+int32_t tune_get_param(const mcumax_params *params, uint32_t index);
+
+/**
+ * @brief Sets a parameter of a parameter block, clamped to its range.
+ */
+void tune_set_param(mcumax_params *params, uint32_t index, int32_t value);
+
+/**
+ * @brief Sets up an opening of random legal moves from the start position.
+ *
+ * @param seed The opening seed; equal seeds give equal openings.
+ * @param plies The number of random plies.
+ * @return The opening is not over (mate or stalemate).
+ */
+bool tune_set_opening(uint64_t seed, uint32_t plies);
+
+/**
+ * @brief Plays a game from the engine's position, each side searching with
+ * its own parameters.
+ *
+ * @param white The parameters of white.
+ * @param black The parameters of black.
+ * @param limits The search limits per move.
+ * @param game The result and statistics.
+ */
+void tune_play_game(const mcumax_params *white, const mcumax_params *black,
+                    const tune_limits *limits, tune_game *game);
+
+#endif
@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# mcu-max hash collision report
+#
+# Builds the UCI example with hashing in shadow mode
+# (MCUMAX_HASH_VERIFY_ENABLED) for each table size, runs its bench and
+# reports how the hash hits split into verified hits, aliases (same pieces,
+# other moved flags, side to move or e.p. square) and key collisions, and
+# how many collisions had their stored score used.
+#
+# (C) 2022-2024 Gissio
+#
+# License: MIT
+#
+
+usage()
+{
+    echo "Usage: hash-report.sh [-d depth] [-n nodes] [entries...]" >&2
+    echo "Entries: table sizes, powers of two (default: 4096 65536 1048576)" >&2
+    exit 1
+}
+
+depth=30
+nodes=500000
+
+while getopts "d:n:" option; do
+    case $option in
+    d) depth=$OPTARG ;;
+    n) nodes=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+sizes=${*:-"4096 65536 1048576"}
+
+root_dir=$(cd "$(dirname "$0")/.." && pwd)
+build_dir=$(mktemp -d)
+trap 'rm -rf "$build_dir"' EXIT
+
+cc=${CC:-cc}
+status=0
+
+printf "%9s %10s %10s %10s %8s %10s %10s %6s\n" \
+    entries probes hits verified aliases collisions per-million used
+
+for size in $sizes; do
+    program="$build_dir/mcu-max-uci-$size"
+
+    if ! $cc -std=c99 -O2 -DMCUMAX_HASHING_ENABLED -DMCUMAX_HASH_VERIFY_ENABLED \
+        -DMCUMAX_HASH_TABLE_SIZE="$size" -I"$root_dir/src" \
+        "$root_dir/examples/mcu-max-uci/main.c" \
+        "$root_dir/examples/mcu-max-uci/perf.c" \
+        "$root_dir/src/mcu-max.c" -o "$program"; then
+        status=1
+        continue
+    fi
+
+    echo "bench $depth $nodes" | "$program" | awk -v size="$size" '
+        /^hash probes/ { probes = $3; hits = $5 }
+        /^hash verified/ { verified = $3; aliases = $5; collisions = $7; used = $NF }
+        END {
+            printf "%9d %10d %10d %10d %8d %10d %10.2f %6d\n", size, probes, hits,
+                verified, aliases, collisions,
+                probes ? 1E6 * collisions / probes : 0, used
+        }'
+done
+
+exit $status
@@ -0,0 +1,196 @@
+/*
+ * mcu-max game annotator
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "annotate.h"
+#include "pgn.h"
+
+#define ANNOTATE_NODE_MAX_DEFAULT 20000
+#define ANNOTATE_DEPTH_MAX_DEFAULT 30
+
+static const char *annotate_judgement_marks[] = {"", "?!", "?", "??"};
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+// Prints one line per ply: move, judgement, score, best move and score
+static void print_annotation(const pgn_game *game, const annotate_game *annotation)
+{
+    pgn_set_start_position(game);
+
+    for (uint32_t i = 0; i < annotation->plies_num; i++)
+    {
+        const annotate_ply *ply = &annotation->plies[i];
+        char san[PGN_SAN_SIZE];
+        char best_san[PGN_SAN_SIZE] = "-";
+
+        bool is_white = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE);
+
+        pgn_move_to_san(ply->move, san);
+        strcat(san, annotate_judgement_marks[ply->judgement]);
+        if (ply->best_move.from != MCUMAX_SQUARE_INVALID)
+            pgn_move_to_san(ply->best_move, best_san);
+
+        printf("%3u%s %-10s %6d  best %-8s %6d  depth %u\n",
+               i / 2 + 1,
+               is_white ? ". " : "...",
+               san,
+               ply->move_score,
+               best_san,
+               ply->score,
+               ply->depth);
+
+        mcumax_play_move(ply->move);
+    }
+
+    printf("\n");
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-annotate [-N nodes] [-d depth] [-i] [-q] file.pgn...\n"
+            "\n"
+            "Annotates games with the score of each move, the best move and its\n"
+            "score, and ?! (inaccuracy), ? (mistake) and ?? (blunder) marks.\n"
+            "Scores are for the side to move; a pawn is about 74.\n"
+            "\n"
+            "  -N  Node limit per position (default: %d)\n"
+            "  -d  Depth limit per position (default: %d)\n"
+            "  -i  Independent searches per position instead of a backward walk\n"
+            "  -q  Only print statistics\n",
+            ANNOTATE_NODE_MAX_DEFAULT,
+            ANNOTATE_DEPTH_MAX_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t node_max = ANNOTATE_NODE_MAX_DEFAULT;
+    uint32_t depth_max = ANNOTATE_DEPTH_MAX_DEFAULT;
+    bool is_independent = false;
+    bool is_quiet = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "N:d:iq")) != -1)
+    {
+        switch (option)
+        {
+        case 'N':
+            node_max = atol(optarg);
+
+            break;
+
+        case 'd':
+            depth_max = atol(optarg);
+
+            break;
+
+        case 'i':
+            is_independent = true;
+
+            break;
+
+        case 'q':
+            is_quiet = true;
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    pgn_game *game = malloc(sizeof(pgn_game));
+    annotate_game *annotation = malloc(sizeof(annotate_game));
+    if (!game || !annotation)
+    {
+        fprintf(stderr, "Out of memory\n");
+
+        return 1;
+    }
+
+    uint64_t games_num = 0;
+    uint64_t plies_num = 0;
+    uint64_t searches_num = 0;
+    uint64_t nodes_num = 0;
+    uint64_t judgements_num[4] = {0, 0, 0, 0};
+
+    double start_time = get_time();
+
+    for (int i = optind; i < argc; i++)
+    {
+        pgn_reader reader;
+        if (!pgn_open(&reader, argv[i]))
+        {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+
+            continue;
+        }
+
+        while (pgn_read_game(&reader, game))
+        {
+            bool is_complete = is_independent
+                                   ? annotate_game_independent(game, node_max, depth_max, annotation)
+                                   : annotate_game_backwards(game, node_max, depth_max, annotation);
+            if (!is_complete)
+                fprintf(stderr, "Game %llu: invalid move after ply %u\n",
+                        (unsigned long long)games_num + 1, annotation->plies_num);
+
+            if (!is_quiet)
+                print_annotation(game, annotation);
+
+            games_num++;
+            plies_num += annotation->plies_num;
+            searches_num += annotation->searches_num;
+            nodes_num += annotation->nodes_num;
+            for (uint32_t j = 0; j < annotation->plies_num; j++)
+                judgements_num[annotation->plies[j].judgement]++;
+        }
+
+        pgn_close(&reader);
+    }
+
+    double total_time = get_time() - start_time;
+
+    fprintf(stderr,
+            "games %llu plies %llu searches %llu nodes %llu\n"
+            "inaccuracies %llu mistakes %llu blunders %llu\n"
+            "time %.3f s plies/s %.1f\n",
+            (unsigned long long)games_num,
+            (unsigned long long)plies_num,
+            (unsigned long long)searches_num,
+            (unsigned long long)nodes_num,
+            (unsigned long long)judgements_num[ANNOTATE_JUDGEMENT_INACCURACY],
+            (unsigned long long)judgements_num[ANNOTATE_JUDGEMENT_MISTAKE],
+            (unsigned long long)judgements_num[ANNOTATE_JUDGEMENT_BLUNDER],
+            total_time,
+            total_time > 0 ? plies_num / total_time : 0);
+
+    free(game);
+    free(annotation);
+
+    return 0;
+}
@@ -0,0 +1,318 @@
+/*
+ * mcu-max compact game archiver
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "archive.h"
+#include "pgn.h"
+
+typedef struct
+{
+    uint64_t games_num;
+    uint64_t games_truncated_num;
+    uint64_t moves_num;
+} archive_stats;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static uint64_t get_file_size(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) ? 0 : st.st_size;
+}
+
+static void set_start_position(const char *fen)
+{
+    if (fen[0])
+        mcumax_set_fen_position(fen);
+    else
+        mcumax_init();
+}
+
+// Converts a PGN game to move indices, up to the first invalid move
+static bool encode_game(const pgn_game *pgn_game, archive_game *game)
+{
+    strcpy(game->fen, pgn_game->fen);
+    game->result = pgn_game->result;
+    game->moves_num = 0;
+
+    set_start_position(game->fen);
+
+    for (uint32_t i = 0; i < pgn_game->moves_num; i++)
+    {
+        mcumax_move move;
+        if (!pgn_parse_san(pgn_game->moves[i], &move))
+            return false;
+
+        int32_t index = archive_encode_move(move);
+        if (index < 0)
+            return false;
+
+        if (!mcumax_play_move(move))
+            return false;
+        game->moves[game->moves_num++] = index;
+    }
+
+    return true;
+}
+
+// Replays a game, converting its moves to SAN if pgn_game is not NULL
+static bool decode_game(const archive_game *game, pgn_game *pgn_game)
+{
+    if (pgn_game)
+    {
+        strcpy(pgn_game->fen, game->fen);
+        pgn_game->result = game->result;
+        pgn_game->moves_num = 0;
+        pgn_game->truncated = false;
+    }
+
+    set_start_position(game->fen);
+
+    for (uint32_t i = 0; i < game->moves_num; i++)
+    {
+        mcumax_move move = archive_decode_move(game->moves[i]);
+        if (move.from == MCUMAX_SQUARE_INVALID)
+            return false;
+
+        if (pgn_game)
+            pgn_move_to_san(move, pgn_game->moves[pgn_game->moves_num++]);
+        if (!mcumax_play_move(move))
+            return false;
+    }
+
+    return true;
+}
+
+static int create_archive(const char *archive_path, int files_num, char **files)
+{
+    static pgn_game pgn_game;
+    static archive_game game;
+
+    archive_writer writer;
+    if (!archive_create(&writer, archive_path))
+    {
+        fprintf(stderr, "Could not create %s\n", archive_path);
+
+        return 1;
+    }
+
+    archive_stats stats = {0};
+    uint64_t pgn_size = 0;
+    double start_time = get_time();
+
+    for (int i = 0; i < files_num; i++)
+    {
+        pgn_reader reader;
+        if (!pgn_open(&reader, files[i]))
+        {
+            fprintf(stderr, "Could not open %s\n", files[i]);
+
+            continue;
+        }
+        pgn_size += get_file_size(files[i]);
+
+        while (pgn_read_game(&reader, &pgn_game))
+        {
+            // Games are kept up to their first unsupported move, or up to
+            // PGN_MOVES_MAX moves
+            if (!encode_game(&pgn_game, &game) || pgn_game.truncated)
+                stats.games_truncated_num++;
+
+            if (!archive_write_game(&writer, &game))
+            {
+                fprintf(stderr, "Could not write %s\n", archive_path);
+
+                return 1;
+            }
+
+            stats.games_num++;
+            stats.moves_num += game.moves_num;
+        }
+
+        pgn_close(&reader);
+    }
+
+    if (!archive_finish(&writer))
+    {
+        fprintf(stderr, "Could not write %s\n", archive_path);
+
+        return 1;
+    }
+
+    double total_time = get_time() - start_time;
+    uint64_t archive_size = get_file_size(archive_path);
+
+    fprintf(stderr,
+            "games %llu (truncated %llu) moves %llu\n"
+            "size %llu -> %llu bytes (%.2f bytes/move, ratio %.1f)\n"
+            "time %.3f s games/s %.0f\n",
+            (unsigned long long)stats.games_num,
+            (unsigned long long)stats.games_truncated_num,
+            (unsigned long long)stats.moves_num,
+            (unsigned long long)pgn_size,
+            (unsigned long long)archive_size,
+            stats.moves_num ? (double)archive_size / stats.moves_num : 0,
+            archive_size ? (double)pgn_size / archive_size : 0,
+            total_time,
+            total_time > 0 ? stats.games_num / total_time : 0);
+
+    return 0;
+}
+
+static int extract_archive(const char *archive_path,
+                           uint32_t first_game,
+                           uint32_t games_max,
+                           bool quiet)
+{
+    static pgn_game pgn_game;
+    static archive_game game;
+
+    archive_reader reader;
+    if (!archive_open(&reader, archive_path))
+    {
+        fprintf(stderr, "Could not open %s\n", archive_path);
+
+        return 1;
+    }
+
+    archive_stats stats = {0};
+    double start_time = get_time();
+
+    if ((first_game < reader.games_num) &&
+        !archive_seek(&reader, first_game))
+    {
+        fprintf(stderr, "Could not read %s\n", archive_path);
+        archive_close(&reader);
+
+        return 1;
+    }
+
+    while ((stats.games_num < games_max) &&
+           (first_game < reader.games_num) &&
+           archive_read_game(&reader, &game))
+    {
+        if (!decode_game(&game, quiet ? NULL : &pgn_game))
+        {
+            fprintf(stderr, "Invalid game %llu\n",
+                    (unsigned long long)(first_game + stats.games_num));
+            archive_close(&reader);
+
+            return 1;
+        }
+
+        if (!quiet)
+            pgn_write_game(stdout, &pgn_game);
+
+        stats.games_num++;
+        stats.moves_num += game.moves_num;
+    }
+
+    archive_close(&reader);
+
+    double total_time = get_time() - start_time;
+
+    fprintf(stderr,
+            "games %llu moves %llu\n"
+            "time %.3f s games/s %.0f\n",
+            (unsigned long long)stats.games_num,
+            (unsigned long long)stats.moves_num,
+            total_time,
+            total_time > 0 ? stats.games_num / total_time : 0);
+
+    return 0;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-archive -c [-o games.mca] file.pgn...\n"
+            "       mcu-max-archive -x [-s first game] [-n games] [-q] games.mca\n"
+            "\n"
+            "  -c  Create an archive from PGN files\n"
+            "  -x  Extract games as PGN to stdout\n"
+            "  -o  Output archive (default: games.mca)\n"
+            "  -s  First game to extract (default: 0)\n"
+            "  -n  Number of games to extract (default: all)\n"
+            "  -q  Decode games without writing them\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *archive_path = "games.mca";
+    bool create = false;
+    bool extract = false;
+    bool quiet = false;
+    uint32_t first_game = 0;
+    uint32_t games_max = UINT32_MAX;
+
+    int option;
+    while ((option = getopt(argc, argv, "cxo:s:n:q")) != -1)
+    {
+        switch (option)
+        {
+        case 'c':
+            create = true;
+
+            break;
+
+        case 'x':
+            extract = true;
+
+            break;
+
+        case 'o':
+            archive_path = optarg;
+
+            break;
+
+        case 's':
+            first_game = strtoul(optarg, NULL, 10);
+
+            break;
+
+        case 'n':
+            games_max = strtoul(optarg, NULL, 10);
+
+            break;
+
+        case 'q':
+            quiet = true;
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if ((create == extract) || (optind >= argc))
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (create)
+        return create_archive(archive_path, argc - optind, argv + optind);
+    else
+        return extract_archive(argv[optind], first_game, games_max, quiet);
+}
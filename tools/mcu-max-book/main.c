@@ -0,0 +1,517 @@
+/*
+ * mcu-max Polyglot opening book builder
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pgn.h"
+#include "polyglot.h"
+
+#define BOOK_SHARDS_NUM 64
+#define BOOK_SHARD_CAPACITY_MIN 4096
+#define BOOK_BATCH_GAMES_NUM 64
+#define BOOK_QUEUE_SIZE 64
+#define BOOK_THREADS_MAX 256
+
+#define BOOK_PLY_MAX_DEFAULT 40
+#define BOOK_GAMES_MIN_DEFAULT 1
+
+typedef struct
+{
+    uint64_t key;
+    uint16_t move;
+    uint32_t games;
+    uint32_t score;
+} book_record;
+
+// Open-addressing hash map, one lock per shard
+typedef struct
+{
+    pthread_mutex_t mutex;
+    book_record *records;
+    size_t records_num;
+    size_t capacity;
+} book_shard;
+
+typedef struct
+{
+    pgn_game games[BOOK_BATCH_GAMES_NUM];
+    uint32_t games_num;
+} book_batch;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    book_batch *batches[BOOK_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t batches_num;
+    bool done;
+} book_queue;
+
+typedef struct
+{
+    pthread_t thread;
+    uint64_t games_num;
+    uint64_t games_skipped_num;
+    uint64_t positions_num;
+} book_worker;
+
+static book_shard book_shards[BOOK_SHARDS_NUM];
+static book_queue book_batch_queue;
+
+static uint32_t book_ply_max = BOOK_PLY_MAX_DEFAULT;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static size_t book_get_index(uint64_t key, uint16_t move, size_t capacity)
+{
+    uint64_t hash = (key ^ (move * 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+
+    return (hash >> 32) & (capacity - 1);
+}
+
+static void book_shard_grow(book_shard *shard)
+{
+    size_t capacity = shard->capacity ? 2 * shard->capacity : BOOK_SHARD_CAPACITY_MIN;
+    book_record *records = calloc(capacity, sizeof(book_record));
+    if (!records)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < shard->capacity; i++)
+    {
+        book_record *record = &shard->records[i];
+        if (!record->games)
+            continue;
+
+        size_t index = book_get_index(record->key, record->move, capacity);
+        while (records[index].games)
+            index = (index + 1) & (capacity - 1);
+        records[index] = *record;
+    }
+
+    free(shard->records);
+    shard->records = records;
+    shard->capacity = capacity;
+}
+
+static void book_insert(uint64_t key, uint16_t move, uint32_t score)
+{
+    book_shard *shard = &book_shards[key >> 58];
+
+    pthread_mutex_lock(&shard->mutex);
+
+    if (2 * (shard->records_num + 1) > shard->capacity)
+        book_shard_grow(shard);
+
+    size_t index = book_get_index(key, move, shard->capacity);
+    book_record *record;
+    while ((record = &shard->records[index])->games &&
+           ((record->key != key) || (record->move != move)))
+        index = (index + 1) & (shard->capacity - 1);
+
+    if (!record->games)
+    {
+        record->key = key;
+        record->move = move;
+        shard->records_num++;
+    }
+    record->games++;
+    record->score += score;
+
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+static void book_queue_push(book_batch *batch)
+{
+    book_queue *queue = &book_batch_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->batches_num == BOOK_QUEUE_SIZE)
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+
+    queue->batches[(queue->head + queue->batches_num) % BOOK_QUEUE_SIZE] = batch;
+    queue->batches_num++;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void book_queue_close(void)
+{
+    book_queue *queue = &book_batch_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->done = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static book_batch *book_queue_pop(void)
+{
+    book_queue *queue = &book_batch_queue;
+    book_batch *batch = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->batches_num && !queue->done)
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+
+    if (queue->batches_num)
+    {
+        batch = queue->batches[queue->head];
+        queue->head = (queue->head + 1) % BOOK_QUEUE_SIZE;
+        queue->batches_num--;
+
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return batch;
+}
+
+// Replays a game and adds its positions; score is 2 per win, 1 per draw
+static void book_add_game(book_worker *worker, const pgn_game *game)
+{
+    if (game->result == PGN_RESULT_UNKNOWN)
+    {
+        worker->games_skipped_num++;
+
+        return;
+    }
+
+    pgn_set_start_position(game);
+
+    uint32_t ply_num = (game->moves_num < book_ply_max) ? game->moves_num : book_ply_max;
+
+    for (uint32_t ply = 0; ply < ply_num; ply++)
+    {
+        mcumax_move move;
+        if (!pgn_parse_san(game->moves[ply], &move))
+            break;
+
+        bool is_white = (mcumax_get_current_side() == MCUMAX_BOARD_WHITE);
+        uint32_t score = (game->result == PGN_RESULT_DRAW)
+                             ? 1
+                         : ((game->result == PGN_RESULT_WHITE_WINS) == is_white)
+                             ? 2
+                             : 0;
+
+        uint64_t key = polyglot_get_key();
+        uint16_t book_move = polyglot_encode_move(move);
+
+        // The SAN fast path does not check pins: the engine rejects those
+        if (!mcumax_play_move(move))
+            break;
+
+        book_insert(key, book_move, score);
+        worker->positions_num++;
+    }
+
+    worker->games_num++;
+}
+
+static void *book_run_worker(void *arg)
+{
+    book_worker *worker = arg;
+    book_batch *batch;
+
+    while ((batch = book_queue_pop()))
+    {
+        for (uint32_t i = 0; i < batch->games_num; i++)
+            book_add_game(worker, &batch->games[i]);
+
+        free(batch);
+    }
+
+    return NULL;
+}
+
+static int book_compare_entries(const void *a, const void *b)
+{
+    const polyglot_entry *entry_a = a;
+    const polyglot_entry *entry_b = b;
+
+    if (entry_a->key != entry_b->key)
+        return (entry_a->key < entry_b->key) ? -1 : 1;
+
+    return (int)entry_b->weight - (int)entry_a->weight;
+}
+
+static bool book_write(const char *path, uint32_t games_min, size_t *entries_num)
+{
+    size_t records_num = 0;
+    uint32_t score_max = 0;
+
+    for (uint32_t i = 0; i < BOOK_SHARDS_NUM; i++)
+        records_num += book_shards[i].records_num;
+
+    polyglot_entry *entries = malloc((records_num ? records_num : 1) * sizeof(polyglot_entry));
+    if (!entries)
+        return false;
+
+    // Collect moves that were played often enough and scored
+    *entries_num = 0;
+    for (uint32_t i = 0; i < BOOK_SHARDS_NUM; i++)
+    {
+        book_shard *shard = &book_shards[i];
+
+        for (size_t j = 0; j < shard->capacity; j++)
+        {
+            book_record *record = &shard->records[j];
+
+            if ((record->games < games_min) || !record->score)
+                continue;
+
+            if (record->score > score_max)
+                score_max = record->score;
+
+            polyglot_entry *entry = &entries[(*entries_num)++];
+            entry->key = record->key;
+            entry->move = record->move;
+            entry->weight = 0;
+            entry->learn = record->score;
+        }
+
+        free(shard->records);
+        shard->records = NULL;
+        shard->records_num = shard->capacity = 0;
+    }
+
+    // Scale weights to 16 bits
+    for (size_t i = 0; i < *entries_num; i++)
+    {
+        polyglot_entry *entry = &entries[i];
+
+        entry->weight = (score_max > 0xffff)
+                            ? (uint16_t)((uint64_t)entry->learn * 0xffff / score_max)
+                            : entry->learn;
+        if (!entry->weight)
+            entry->weight = 1;
+        entry->learn = 0;
+    }
+
+    qsort(entries, *entries_num, sizeof(polyglot_entry), book_compare_entries);
+
+    FILE *file = fopen(path, "wb");
+    bool success = (file != NULL);
+
+    for (size_t i = 0; success && (i < *entries_num); i++)
+        success = polyglot_write_entry(file, &entries[i]);
+
+    if (file && fclose(file))
+        success = false;
+
+    free(entries);
+
+    return success;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-book [-r random64.txt] [-o book.bin] [-t threads]\n"
+            "                    [-p max plies] [-m min games] file.pgn...\n"
+            "\n"
+            "  -r  Random64[] table (781 hexadecimal numbers) replacing the\n"
+            "      built-in Polyglot table; it must give the standard keys\n"
+            "  -o  Output book (default: book.bin)\n"
+            "  -t  Worker threads (default: number of CPUs)\n"
+            "  -p  Plies per game added to the book (default: %d)\n"
+            "  -m  Minimum games per move (default: %d)\n",
+            BOOK_PLY_MAX_DEFAULT,
+            BOOK_GAMES_MIN_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    const char *random_path = NULL;
+    const char *book_path = "book.bin";
+    long threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t games_min = BOOK_GAMES_MIN_DEFAULT;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:o:t:p:m:")) != -1)
+    {
+        switch (option)
+        {
+        case 'r':
+            random_path = optarg;
+
+            break;
+
+        case 'o':
+            book_path = optarg;
+
+            break;
+
+        case 't':
+            threads_num = atol(optarg);
+
+            break;
+
+        case 'p':
+            book_ply_max = atoi(optarg);
+
+            break;
+
+        case 'm':
+            games_min = atoi(optarg);
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (random_path)
+    {
+        if (!polyglot_load_random(random_path))
+        {
+            fprintf(stderr, "Could not load %d random numbers from %s\n",
+                    POLYGLOT_RANDOM_NUM, random_path);
+
+            return 1;
+        }
+
+        if (!polyglot_check_random())
+        {
+            fprintf(stderr, "%s is not the Polyglot Random64[] table\n",
+                    random_path);
+
+            return 1;
+        }
+    }
+
+    if (threads_num < 1)
+        threads_num = 1;
+    if (threads_num > BOOK_THREADS_MAX)
+        threads_num = BOOK_THREADS_MAX;
+
+    for (uint32_t i = 0; i < BOOK_SHARDS_NUM; i++)
+        pthread_mutex_init(&book_shards[i].mutex, NULL);
+
+    pthread_mutex_init(&book_batch_queue.mutex, NULL);
+    pthread_cond_init(&book_batch_queue.not_empty, NULL);
+    pthread_cond_init(&book_batch_queue.not_full, NULL);
+
+    book_worker workers[BOOK_THREADS_MAX];
+    memset(workers, 0, sizeof(workers));
+
+    double start_time = get_time();
+
+    for (long i = 0; i < threads_num; i++)
+        pthread_create(&workers[i].thread, NULL, book_run_worker, &workers[i]);
+
+    // Stream games to the workers in batches
+    book_batch *batch = NULL;
+
+    for (int i = optind; i < argc; i++)
+    {
+        pgn_reader reader;
+        if (!pgn_open(&reader, argv[i]))
+        {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+
+            continue;
+        }
+
+        while (true)
+        {
+            if (!batch)
+            {
+                batch = malloc(sizeof(book_batch));
+                if (!batch)
+                {
+                    fprintf(stderr, "Out of memory\n");
+
+                    return 1;
+                }
+                batch->games_num = 0;
+            }
+
+            if (!pgn_read_game(&reader, &batch->games[batch->games_num]))
+                break;
+
+            if (++batch->games_num == BOOK_BATCH_GAMES_NUM)
+            {
+                book_queue_push(batch);
+                batch = NULL;
+            }
+        }
+
+        pgn_close(&reader);
+    }
+
+    if (batch && batch->games_num)
+        book_queue_push(batch);
+    else
+        free(batch);
+
+    book_queue_close();
+
+    uint64_t games_num = 0;
+    uint64_t games_skipped_num = 0;
+    uint64_t positions_num = 0;
+
+    for (long i = 0; i < threads_num; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+
+        games_num += workers[i].games_num;
+        games_skipped_num += workers[i].games_skipped_num;
+        positions_num += workers[i].positions_num;
+    }
+
+    double replay_time = get_time() - start_time;
+
+    size_t entries_num;
+    if (!book_write(book_path, games_min, &entries_num))
+    {
+        fprintf(stderr, "Could not write %s\n", book_path);
+
+        return 1;
+    }
+
+    double total_time = get_time() - start_time;
+
+    fprintf(stderr,
+            "games %llu (skipped %llu) positions %llu entries %zu\n"
+            "time %.3f s (replay %.3f s) games/s %.0f\n",
+            (unsigned long long)games_num,
+            (unsigned long long)games_skipped_num,
+            (unsigned long long)positions_num,
+            entries_num,
+            total_time,
+            replay_time,
+            replay_time > 0 ? games_num / replay_time : 0);
+
+    return 0;
+}
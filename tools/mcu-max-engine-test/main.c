@@ -0,0 +1,211 @@
+/*
+ * mcu-max engine test
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mcu-max.h"
+
+static bool test_result(bool passed, const char *name)
+{
+    printf("%s: %s\n", passed ? "pass" : "FAIL", name);
+
+    return passed;
+}
+
+static mcumax_square get_square(const char *s)
+{
+    return 0x10 * ('8' - s[1]) + (s[0] - 'a');
+}
+
+static mcumax_move get_move(const char *s)
+{
+    return (mcumax_move){get_square(s), get_square(s + 2)};
+}
+
+// Plays moves in UCI notation, separated by spaces
+static bool play_moves(const char *moves)
+{
+    for (const char *s = moves; *s; s += (s[4] == ' ') ? 5 : 4)
+        if (!mcumax_play_move(get_move(s)))
+            return false;
+
+    return true;
+}
+
+static bool is_valid_move(mcumax_move move)
+{
+    mcumax_move valid_moves[256];
+    uint32_t valid_moves_num = mcumax_search_valid_moves(valid_moves, 256);
+
+    for (uint32_t i = 0; i < valid_moves_num; i++)
+        if ((valid_moves[i].from == move.from) &&
+            (valid_moves[i].to == move.to))
+            return true;
+
+    return false;
+}
+
+// Checks a move against the valid move list and mcumax_play_move()
+static bool test_move(const char *fen, const char *move_string, bool is_legal)
+{
+    mcumax_move move = get_move(move_string);
+
+    mcumax_set_fen_position(fen);
+    bool passed = (is_valid_move(move) == is_legal);
+    passed &= (mcumax_play_move(move) == is_legal);
+
+    printf("%s: %s %s %s\n",
+           passed ? "pass" : "FAIL", fen, move_string, is_legal ? "legal" : "illegal");
+
+    return passed;
+}
+
+static bool test_illegal_moves(void)
+{
+    bool passed = true;
+
+    // Pinned knight
+    passed &= test_move("4k3/4r3/8/8/8/8/4N3/4K3 w - - 0 1", "e2c3", false);
+    passed &= test_move("4k3/4r3/8/8/8/8/4N3/4K3 w - - 0 1", "e1d1", true);
+    // Pinned pawn capturing off the pin line
+    passed &= test_move("4k3/8/8/8/1b6/4n3/3P4/4K3 w - - 0 1", "d2e3", false);
+    passed &= test_move("4k3/8/8/8/1b6/2n5/3P4/4K3 w - - 0 1", "d2c3", true);
+    passed &= test_move("4k3/8/8/1b6/8/3P4/4K3/8 w - - 0 1", "d3d4", false);
+    // Castling through, into and out of check
+    passed &= test_move("4k3/8/8/8/8/8/5r2/R3K2R w KQ - 0 1", "e1g1", false);
+    passed &= test_move("4k3/8/8/8/8/8/5r2/R3K2R w KQ - 0 1", "e1c1", true);
+    passed &= test_move("4k3/8/8/8/8/8/6r1/R3K2R w KQ - 0 1", "e1g1", false);
+    passed &= test_move("4k3/8/8/8/8/8/5q2/R3K2R w KQ - 0 1", "e1c1", false);
+    // En passant capture uncovering a check along the rank
+    passed &= test_move("8/8/8/KPp4r/8/8/8/4k3 w - c6 0 1", "b5c6", false);
+    passed &= test_move("8/8/8/KPp4r/8/8/8/4k3 w - c6 0 1", "b5b6", true);
+    passed &= test_move("8/8/8/1Pp4r/8/K7/8/4k3 w - c6 0 1", "b5c6", true);
+
+    return test_result(passed, "illegal move rejection");
+}
+
+// The game end helpers must not change the squares of the move played
+static bool test_changed_squares(void)
+{
+    mcumax_init();
+    bool passed = play_moves("f2f3 e7e5 g2g4 d8h4");
+
+    uint64_t changed_squares = mcumax_get_changed_squares();
+    passed &= (changed_squares == (MCUMAX_SQUARE_BIT(get_square("d8")) |
+                                   MCUMAX_SQUARE_BIT(get_square("h4"))));
+
+    passed &= mcumax_is_in_checkmate(MCUMAX_BOARD_WHITE);
+    passed &= !mcumax_is_stalemate(MCUMAX_BOARD_WHITE);
+    passed &= !mcumax_is_in_checkmate(MCUMAX_BOARD_BLACK);
+    passed &= !mcumax_is_stalemate(MCUMAX_BOARD_BLACK);
+    passed &= (mcumax_get_changed_squares() == changed_squares);
+
+    return test_result(passed, "changed squares after game end checks");
+}
+
+#ifdef MCUMAX_REPETITION_ENABLED
+// Shuffles knights, so the history holds reversible plies, then searches
+static uint32_t get_shuffle_search_nodes(bool check_game_end, bool *passed)
+{
+    mcumax_init();
+    *passed &= play_moves("g1f3 g8f6 f3g1 f6g8 g1f3 g8f6");
+
+    if (check_game_end)
+    {
+        mcumax_struct state = mcumax;
+
+        *passed &= !mcumax_is_stalemate(mcumax_get_current_side());
+        *passed &= !mcumax_is_in_checkmate(mcumax_get_current_side());
+        *passed &= (mcumax.history_num == state.history_num) &&
+                   (mcumax.reversible_plies == state.reversible_plies) &&
+                   (mcumax.hash_key == state.hash_key) &&
+                   (mcumax.hash_key2 == state.hash_key2) &&
+                   !memcmp(mcumax.key_history, state.key_history,
+                           sizeof(state.key_history)) &&
+                   !memcmp(mcumax.key2_history, state.key2_history,
+                           sizeof(state.key2_history));
+    }
+
+    mcumax_search_best_move(UINT32_MAX, 4);
+
+    return mcumax.node_count;
+}
+
+// The game end helpers must not add positions to the game history
+static bool test_history(void)
+{
+    bool passed = true;
+
+    uint32_t node_count = get_shuffle_search_nodes(false, &passed);
+    passed &= (get_shuffle_search_nodes(true, &passed) == node_count);
+
+    return test_result(passed, "game history after game end checks");
+}
+#endif
+
+#ifdef MCUMAX_PV_ENABLED
+// Plays the engine's move and the reply its PV predicts, then searches
+static uint32_t get_seeded_search_nodes(bool check_game_end, bool *passed)
+{
+    mcumax_init();
+    mcumax_move move = mcumax_search_best_move(UINT32_MAX, 4);
+
+    *passed &= mcumax_play_move(move) &&
+               (mcumax.pv_num >= 2) &&
+               mcumax_play_move((mcumax_move){mcumax.pv[1].from,
+                                              mcumax.pv[1].to & ~MCUMAX_SQUARE_INVALID});
+
+    if (check_game_end)
+    {
+        uint8_t pv_num = mcumax.pv_num;
+        uint8_t pv_played = mcumax.pv_played;
+        uint8_t pv_depth = mcumax.pv_depth;
+        mcumax_move pv[MCUMAX_PV_LENGTH];
+        memcpy(pv, mcumax.pv, sizeof(pv));
+
+        *passed &= !mcumax_is_stalemate(mcumax_get_current_side());
+        *passed &= !mcumax_is_in_checkmate(mcumax_get_current_side());
+        *passed &= (mcumax.pv_num == pv_num) &&
+                   (mcumax.pv_played == pv_played) &&
+                   (mcumax.pv_depth == pv_depth) &&
+                   !memcmp(mcumax.pv, pv, sizeof(pv));
+    }
+
+    mcumax_search_best_move(UINT32_MAX, 4);
+
+    return mcumax.node_count;
+}
+
+// The game end helpers must keep the PV that seeds the next search
+static bool test_pv_seed(void)
+{
+    bool passed = true;
+
+    uint32_t node_count = get_seeded_search_nodes(false, &passed);
+    passed &= (get_seeded_search_nodes(true, &passed) == node_count);
+
+    return test_result(passed, "PV seed after game end checks");
+}
+#endif
+
+int main(void)
+{
+    bool passed = true;
+
+    passed &= test_illegal_moves();
+    passed &= test_changed_squares();
+#ifdef MCUMAX_REPETITION_ENABLED
+    passed &= test_history();
+#endif
+#ifdef MCUMAX_PV_ENABLED
+    passed &= test_pv_seed();
+#endif
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,495 @@
+/*
+ * mcu-max analysis server load generator
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "analysis.h"
+
+#define LOAD_CONNECTIONS_MAX 256
+#define LOAD_POSITIONS_MAX 4096
+
+#define LOAD_REQUESTS_NUM_DEFAULT 1000
+#define LOAD_WINDOW_DEFAULT 64
+#define LOAD_NODE_MAX_DEFAULT 10000
+
+static const char *load_default_fens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+};
+
+typedef struct
+{
+    int fd_in;
+    int fd_out;
+    pthread_t thread;
+
+    uint32_t first_id;
+    uint32_t requests_num;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t window_free;
+    uint32_t in_flight_num;
+    bool is_closed;
+
+    uint32_t responses_num;
+    uint32_t errors_num;
+    uint32_t cached_num;
+    uint64_t nodes_num;
+    uint64_t search_time_us;
+} load_connection;
+
+static analysis_position load_positions[LOAD_POSITIONS_MAX];
+static uint32_t load_positions_num;
+
+static uint32_t load_window = LOAD_WINDOW_DEFAULT;
+static uint32_t load_node_max = LOAD_NODE_MAX_DEFAULT;
+static uint32_t load_depth_max;
+
+static double *load_send_times;
+static double *load_latencies;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static bool load_read_positions(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char line[ANALYSIS_FEN_SIZE];
+
+    while ((load_positions_num < LOAD_POSITIONS_MAX) &&
+           fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!line[0])
+            continue;
+
+        if (analysis_pack_fen(line, &load_positions[load_positions_num]))
+            load_positions_num++;
+        else
+            fprintf(stderr, "Invalid FEN: %s\n", line);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+// Sends a connection's requests, keeping at most load_window in flight
+static void *load_run_sender(void *arg)
+{
+    load_connection *connection = arg;
+
+    for (uint32_t i = 0; i < connection->requests_num; i++)
+    {
+        analysis_request request;
+        uint8_t frame[4 + ANALYSIS_REQUEST_SIZE];
+
+        request.id = connection->first_id + i;
+        request.node_max = load_node_max;
+        request.depth_max = load_depth_max;
+        request.score_max = ANALYSIS_SCORE_MAX;
+        request.position = load_positions[request.id % load_positions_num];
+
+        pthread_mutex_lock(&connection->mutex);
+        while ((connection->in_flight_num >= load_window) && !connection->is_closed)
+            pthread_cond_wait(&connection->window_free, &connection->mutex);
+        connection->in_flight_num++;
+        bool is_closed = connection->is_closed;
+        pthread_mutex_unlock(&connection->mutex);
+
+        if (is_closed)
+            break;
+
+        size_t frame_size = analysis_encode_request(&request, frame);
+
+        load_send_times[request.id] = get_time();
+        if (!analysis_write(connection->fd_out, frame, frame_size))
+            break;
+    }
+
+    return NULL;
+}
+
+static void load_run_receiver(load_connection *connection)
+{
+    uint8_t payload[ANALYSIS_FRAME_SIZE_MAX];
+    uint32_t payload_size;
+
+    while ((connection->responses_num < connection->requests_num) &&
+           analysis_read_frame(connection->fd_in, payload, &payload_size))
+    {
+        analysis_response response;
+
+        if (!analysis_decode_response(payload, payload_size, &response) ||
+            (response.id - connection->first_id >= connection->requests_num))
+        {
+            fprintf(stderr, "Invalid response\n");
+
+            break;
+        }
+
+        load_latencies[response.id] = get_time() - load_send_times[response.id];
+
+        connection->responses_num++;
+        connection->errors_num += (response.status != ANALYSIS_STATUS_OK);
+        connection->cached_num += !!(response.flags & ANALYSIS_FLAG_CACHED);
+        connection->search_time_us += response.time_us;
+
+        // Nodes searched for this request
+        if (!(response.flags & ANALYSIS_FLAG_CACHED))
+            connection->nodes_num += response.nodes_num;
+
+        pthread_mutex_lock(&connection->mutex);
+        connection->in_flight_num--;
+        pthread_cond_signal(&connection->window_free);
+        pthread_mutex_unlock(&connection->mutex);
+    }
+
+    // Release the sender if the server stopped answering
+    pthread_mutex_lock(&connection->mutex);
+    connection->is_closed = true;
+    pthread_cond_signal(&connection->window_free);
+    pthread_mutex_unlock(&connection->mutex);
+}
+
+static void *load_run_connection(void *arg)
+{
+    load_connection *connection = arg;
+    pthread_t sender;
+
+    pthread_create(&sender, NULL, load_run_sender, connection);
+    load_run_receiver(connection);
+    pthread_join(sender, NULL);
+
+    return NULL;
+}
+
+static int load_connect(const char *path)
+{
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        close(fd);
+
+        return -1;
+    }
+
+    return fd;
+}
+
+// Starts a server on the other end of two pipes
+static pid_t load_spawn(char **command, int *fd_in, int *fd_out)
+{
+    int request_pipe[2];
+    int response_pipe[2];
+
+    if (pipe(request_pipe))
+        return -1;
+    if (pipe(response_pipe))
+    {
+        close(request_pipe[0]);
+        close(request_pipe[1]);
+
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (!pid)
+    {
+        dup2(request_pipe[0], STDIN_FILENO);
+        dup2(response_pipe[1], STDOUT_FILENO);
+        close(request_pipe[0]);
+        close(request_pipe[1]);
+        close(response_pipe[0]);
+        close(response_pipe[1]);
+
+        execvp(command[0], command);
+        _exit(127);
+    }
+
+    close(request_pipe[0]);
+    close(response_pipe[1]);
+
+    *fd_out = request_pipe[1];
+    *fd_in = response_pipe[0];
+
+    return pid;
+}
+
+static int load_compare_latencies(const void *a, const void *b)
+{
+    double latency_a = *(const double *)a;
+    double latency_b = *(const double *)b;
+
+    return (latency_a > latency_b) - (latency_a < latency_b);
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-load [-n requests] [-w window] [-N nodes] [-d depth]\n"
+            "                    [-f positions.fen] -s socket [-c connections]\n"
+            "       mcu-max-load [options] -- server command...\n"
+            "\n"
+            "Sends pipelined requests to an analysis server and reports throughput\n"
+            "and latency. Without -s, the server command is started with pipes.\n"
+            "\n"
+            "  -n  Requests (default: %d)\n"
+            "  -w  Requests in flight per connection (default: %d)\n"
+            "  -N  Node limit per request (default: %d)\n"
+            "  -d  Depth limit per request (default: server default)\n"
+            "  -f  FEN positions, one per line (default: built-in positions)\n"
+            "  -s  Unix socket path of a running server\n"
+            "  -c  Connections to the socket (default: 1)\n",
+            LOAD_REQUESTS_NUM_DEFAULT,
+            LOAD_WINDOW_DEFAULT,
+            LOAD_NODE_MAX_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = NULL;
+    const char *positions_path = NULL;
+    uint32_t requests_num = LOAD_REQUESTS_NUM_DEFAULT;
+    uint32_t connections_num = 1;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:w:N:d:f:s:c:")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            requests_num = atol(optarg);
+
+            break;
+
+        case 'w':
+            load_window = atol(optarg);
+
+            break;
+
+        case 'N':
+            load_node_max = atol(optarg);
+
+            break;
+
+        case 'd':
+            load_depth_max = atol(optarg);
+
+            break;
+
+        case 'f':
+            positions_path = optarg;
+
+            break;
+
+        case 's':
+            socket_path = optarg;
+
+            break;
+
+        case 'c':
+            connections_num = atol(optarg);
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if ((!socket_path == (optind >= argc)) ||
+        !requests_num ||
+        !load_window ||
+        (load_depth_max > 0xff))
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (!socket_path)
+        connections_num = 1;
+    if (connections_num < 1)
+        connections_num = 1;
+    if (connections_num > LOAD_CONNECTIONS_MAX)
+        connections_num = LOAD_CONNECTIONS_MAX;
+
+    if (positions_path)
+    {
+        if (!load_read_positions(positions_path))
+        {
+            fprintf(stderr, "Could not open %s\n", positions_path);
+
+            return 1;
+        }
+    }
+    else
+    {
+        for (uint32_t i = 0; i < sizeof(load_default_fens) / sizeof(load_default_fens[0]); i++)
+            analysis_pack_fen(load_default_fens[i], &load_positions[load_positions_num++]);
+    }
+
+    if (!load_positions_num)
+    {
+        fprintf(stderr, "No positions\n");
+
+        return 1;
+    }
+
+    load_send_times = calloc(requests_num, sizeof(double));
+    load_latencies = calloc(requests_num, sizeof(double));
+    if (!load_send_times || !load_latencies)
+    {
+        fprintf(stderr, "Out of memory\n");
+
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    load_connection connections[LOAD_CONNECTIONS_MAX];
+    memset(connections, 0, sizeof(connections));
+
+    pid_t server_pid = -1;
+
+    for (uint32_t i = 0; i < connections_num; i++)
+    {
+        load_connection *connection = &connections[i];
+
+        if (socket_path)
+        {
+            connection->fd_in =
+                connection->fd_out = load_connect(socket_path);
+        }
+        else
+            server_pid = load_spawn(argv + optind, &connection->fd_in, &connection->fd_out);
+
+        if (socket_path ? (connection->fd_in < 0) : (server_pid < 0))
+        {
+            fprintf(stderr, "Could not connect to the server\n");
+
+            return 1;
+        }
+
+        connection->first_id = (uint64_t)requests_num * i / connections_num;
+        connection->requests_num = (uint64_t)requests_num * (i + 1) / connections_num -
+                                   connection->first_id;
+        pthread_mutex_init(&connection->mutex, NULL);
+        pthread_cond_init(&connection->window_free, NULL);
+    }
+
+    double start_time = get_time();
+
+    for (uint32_t i = 0; i < connections_num; i++)
+        pthread_create(&connections[i].thread, NULL, load_run_connection, &connections[i]);
+
+    uint32_t responses_num = 0;
+    uint32_t errors_num = 0;
+    uint32_t cached_num = 0;
+    uint64_t nodes_num = 0;
+    uint64_t search_time_us = 0;
+
+    for (uint32_t i = 0; i < connections_num; i++)
+    {
+        load_connection *connection = &connections[i];
+
+        pthread_join(connection->thread, NULL);
+
+        responses_num += connection->responses_num;
+        errors_num += connection->errors_num;
+        cached_num += connection->cached_num;
+        nodes_num += connection->nodes_num;
+        search_time_us += connection->search_time_us;
+    }
+
+    double total_time = get_time() - start_time;
+
+    for (uint32_t i = 0; i < connections_num; i++)
+    {
+        close(connections[i].fd_out);
+        if (connections[i].fd_in != connections[i].fd_out)
+            close(connections[i].fd_in);
+    }
+
+    if (server_pid > 0)
+        waitpid(server_pid, NULL, 0);
+
+    // Latencies of answered requests
+    uint32_t latencies_num = 0;
+
+    for (uint32_t i = 0; i < requests_num; i++)
+        if (load_latencies[i] > 0)
+            load_latencies[latencies_num++] = load_latencies[i];
+
+    qsort(load_latencies, latencies_num, sizeof(double), load_compare_latencies);
+
+    double latency_sum = 0;
+    for (uint32_t i = 0; i < latencies_num; i++)
+        latency_sum += load_latencies[i];
+
+    fprintf(stderr,
+            "requests %u responses %u errors %u cached %u connections %u window %u\n"
+            "time %.3f s requests/s %.0f nodes/s %.0f search time/request %.3f ms\n",
+            requests_num,
+            responses_num,
+            errors_num,
+            cached_num,
+            connections_num,
+            load_window,
+            total_time,
+            responses_num / total_time,
+            nodes_num / total_time,
+            responses_num ? 1E-3 * search_time_us / responses_num : 0);
+    if (latencies_num)
+        fprintf(stderr,
+                "latency mean %.3f ms p50 %.3f ms p99 %.3f ms\n",
+                1E3 * latency_sum / latencies_num,
+                1E3 * load_latencies[latencies_num / 2],
+                1E3 * load_latencies[latencies_num * 99 / 100]);
+
+    free(load_send_times);
+    free(load_latencies);
+
+    return (responses_num == requests_num) ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+/*
+ * mcu-max parallel search test
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "mcu-max.h"
+
+#define TEST_DEPTH 4
+#define TEST_NODE_MAX 100000000
+#define TEST_STOP_DEPTH 90
+#define TEST_STOP_TIME 0.1
+#define TEST_STOP_TIME_MAX 2.0
+
+static const char *test_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1",
+};
+
+static double stop_time;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static void stop_callback(void *userdata)
+{
+    (void)userdata;
+
+    if (get_time() >= stop_time)
+        mcumax_stop_search();
+}
+
+// The result and node count must not depend on the number of threads
+static bool test_determinism(const char *fen)
+{
+    mcumax_move moves[2];
+    uint32_t node_counts[2];
+    static const uint32_t threads_nums[2] = {1, 4};
+
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        mcumax_set_threads(threads_nums[i]);
+        mcumax_set_fen_position(fen);
+
+        moves[i] = mcumax_search_best_move(TEST_NODE_MAX, TEST_DEPTH);
+        node_counts[i] = mcumax.node_count;
+    }
+
+    bool passed = (moves[0].from == moves[1].from) &&
+                  (moves[0].to == moves[1].to) &&
+                  (node_counts[0] == node_counts[1]);
+
+    printf("%s: %s 1 thread %u nodes, 4 threads %u nodes\n",
+           passed ? "pass" : "FAIL", fen, node_counts[0], node_counts[1]);
+
+    return passed;
+}
+
+// A stop request during the root split must end all threads promptly and
+// leave the engine ready for the next search
+static bool test_stop(const char *fen)
+{
+    mcumax_set_threads(4);
+    mcumax_set_fen_position(fen);
+    mcumax_set_callback(stop_callback, NULL);
+
+    double start_time = get_time();
+    stop_time = start_time + TEST_STOP_TIME;
+    mcumax_move move = mcumax_search_best_move(TEST_NODE_MAX, TEST_STOP_DEPTH);
+    double elapsed_time = get_time() - start_time;
+
+    mcumax_set_callback(NULL, NULL);
+
+    // Like a serial search, a stopped search may return no move
+    bool passed = (elapsed_time < TEST_STOP_TIME_MAX) &&
+                  ((move.from == MCUMAX_SQUARE_INVALID) ||
+                   mcumax_play_move(move));
+
+    printf("%s: stop after %.3f s\n", passed ? "pass" : "FAIL", elapsed_time);
+
+    return passed;
+}
+
+int main(void)
+{
+    uint32_t positions_num = sizeof(test_positions) / sizeof(test_positions[0]);
+    bool passed = true;
+
+    for (uint32_t i = 0; i < positions_num; i++)
+        passed &= test_determinism(test_positions[i]);
+
+    passed &= test_stop(test_positions[1]);
+
+    // The stopped search must not affect the next one
+    passed &= test_determinism(test_positions[1]);
+
+    return passed ? 0 : 1;
+}
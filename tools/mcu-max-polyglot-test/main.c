@@ -0,0 +1,69 @@
+/*
+ * mcu-max Polyglot key test
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <stdio.h>
+
+#include "polyglot.h"
+
+// Keys from the Polyglot book format specification
+static const struct
+{
+    const char *moves;
+    uint64_t key;
+} test_keys[] = {
+    {"", 0x463b96181691fc9cULL},
+    {"e2e4", 0x823c9b50fd114196ULL},
+    {"e2e4 d7d5", 0x0756b94461c50fb0ULL},
+    {"e2e4 d7d5 e4e5", 0x662fafb965db29d4ULL},
+    {"e2e4 d7d5 e4e5 f7f5", 0x22a48b5a8e47ff78ULL},
+    {"e2e4 d7d5 e4e5 f7f5 e1e2", 0x652a607ca3f242c1ULL},
+    {"e2e4 d7d5 e4e5 f7f5 e1e2 e8f7", 0x00fdd303c946bdd9ULL},
+    {"a2a4 b7b5 h2h4 b5b4 c2c4", 0x3c8123ea7b067637ULL},
+    {"a2a4 b7b5 h2h4 b5b4 c2c4 b4c3 a1a3", 0x5c3f9b829b279560ULL},
+};
+
+static mcumax_square get_square(const char *s)
+{
+    return 0x10 * ('8' - s[1]) + (s[0] - 'a');
+}
+
+// Plays moves in UCI notation, separated by spaces
+static bool play_moves(const char *moves)
+{
+    for (const char *s = moves; *s; s += (s[4] == ' ') ? 5 : 4)
+        if (!mcumax_play_move((mcumax_move){get_square(s), get_square(s + 2)}))
+            return false;
+
+    return true;
+}
+
+static bool test_key(const char *moves, uint64_t key)
+{
+    mcumax_init();
+    bool passed = play_moves(moves) &&
+                  (polyglot_get_key() == key);
+
+    printf("%s: %016llx %s\n",
+           passed ? "pass" : "FAIL", (unsigned long long)key, moves);
+
+    return passed;
+}
+
+int main(void)
+{
+    uint32_t keys_num = sizeof(test_keys) / sizeof(test_keys[0]);
+
+    // The built-in table must be Polyglot's Random64[]
+    bool passed = polyglot_check_random();
+    printf("%s: start key\n", passed ? "pass" : "FAIL");
+
+    for (uint32_t i = 0; i < keys_num; i++)
+        passed &= test_key(test_keys[i].moves, test_keys[i].key);
+
+    return passed ? 0 : 1;
+}
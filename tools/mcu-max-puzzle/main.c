@@ -0,0 +1,329 @@
+/*
+ * mcu-max tactical puzzle miner
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "puzzle.h"
+
+#define PUZZLE_QUEUE_SIZE 64
+#define PUZZLE_THREADS_MAX 256
+
+#define PUZZLE_NODE_MAX_DEFAULT 20000
+#define PUZZLE_DEPTH_MAX_DEFAULT 30
+#define PUZZLE_LINE_PLIES_DEFAULT 3
+
+typedef struct
+{
+    pgn_game *game;
+    uint64_t index;
+} puzzle_job;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    puzzle_job jobs[PUZZLE_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t jobs_num;
+    bool done;
+} puzzle_queue;
+
+typedef struct
+{
+    uint64_t games_num;
+    uint64_t invalid_games_num;
+    uint64_t plies_num;
+    uint64_t candidates_num;
+    uint64_t searches_num;
+    uint64_t nodes_num;
+    uint64_t puzzles_num;
+} puzzle_stats;
+
+static puzzle_queue puzzle_job_queue;
+static puzzle_limits puzzle_search_limits;
+
+// Guards stdout and the statistics
+static pthread_mutex_t puzzle_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static puzzle_stats puzzle_total_stats;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static void puzzle_queue_push(const puzzle_job *job)
+{
+    puzzle_queue *queue = &puzzle_job_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->jobs_num == PUZZLE_QUEUE_SIZE)
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+
+    queue->jobs[(queue->head + queue->jobs_num) % PUZZLE_QUEUE_SIZE] = *job;
+    queue->jobs_num++;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void puzzle_queue_close(void)
+{
+    puzzle_queue *queue = &puzzle_job_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->done = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static bool puzzle_queue_pop(puzzle_job *job)
+{
+    puzzle_queue *queue = &puzzle_job_queue;
+    bool is_popped = false;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->jobs_num && !queue->done)
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+
+    if (queue->jobs_num)
+    {
+        *job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % PUZZLE_QUEUE_SIZE;
+        queue->jobs_num--;
+        is_popped = true;
+
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return is_popped;
+}
+
+// Prints a puzzle as: FEN,solution line (UCI),gain,second gain,game,ply
+static void print_puzzle(const puzzle *puzzle, uint64_t index)
+{
+    printf("%s,", puzzle->fen);
+
+    for (uint32_t i = 0; i < puzzle->line_num; i++)
+    {
+        char uci[6];
+
+        pgn_move_to_uci(puzzle->line[i], uci);
+        printf("%s%s", i ? " " : "", uci);
+    }
+
+    printf(",%d,%d,%llu,%u\n",
+           puzzle->gain,
+           puzzle->second_gain,
+           (unsigned long long)index + 1,
+           puzzle->ply + 1);
+}
+
+// Each worker thread owns one engine (the engine state is thread-local)
+static void *puzzle_run_worker(void *arg)
+{
+    (void)arg;
+
+    puzzle_game *result = malloc(sizeof(puzzle_game));
+    if (!result)
+        return NULL;
+
+    puzzle_job job;
+
+    while (puzzle_queue_pop(&job))
+    {
+        bool is_complete = puzzle_mine_game(job.game, &puzzle_search_limits, result);
+
+        pthread_mutex_lock(&puzzle_output_mutex);
+
+        for (uint32_t i = 0; i < result->puzzles_num; i++)
+            print_puzzle(&result->puzzles[i], job.index);
+
+        puzzle_stats *stats = &puzzle_total_stats;
+        stats->games_num++;
+        stats->invalid_games_num += !is_complete;
+        stats->plies_num += result->plies_num;
+        stats->candidates_num += result->candidates_num;
+        stats->searches_num += result->searches_num;
+        stats->nodes_num += result->nodes_num;
+        stats->puzzles_num += result->puzzles_num;
+
+        pthread_mutex_unlock(&puzzle_output_mutex);
+
+        free(job.game);
+    }
+
+    free(result);
+
+    return NULL;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-puzzle [-t threads] [-N nodes] [-n nodes] [-d depth] [-l plies]\n"
+            "                      file.pgn...\n"
+            "\n"
+            "Mines tactical puzzles (positions where exactly one move wins) from\n"
+            "PGN games, printing one line per puzzle:\n"
+            "FEN,solution line (UCI),gain,second best gain,game,ply\n"
+            "Gains are in engine units (a pawn is about 74).\n"
+            "\n"
+            "  -t  Engine threads (default: number of CPUs)\n"
+            "  -N  Node limit of the best move search (default: %d)\n"
+            "  -n  Node limit per other move (default: a quarter of -N)\n"
+            "  -d  Depth limit (default: %d)\n"
+            "  -l  Plies of the solution line (default: %d)\n",
+            PUZZLE_NODE_MAX_DEFAULT,
+            PUZZLE_DEPTH_MAX_DEFAULT,
+            PUZZLE_LINE_PLIES_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    long threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    puzzle_search_limits.node_max = PUZZLE_NODE_MAX_DEFAULT;
+    puzzle_search_limits.depth_max = PUZZLE_DEPTH_MAX_DEFAULT;
+    puzzle_search_limits.line_plies = PUZZLE_LINE_PLIES_DEFAULT;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:N:n:d:l:")) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            threads_num = atol(optarg);
+
+            break;
+
+        case 'N':
+            puzzle_search_limits.node_max = atol(optarg);
+
+            break;
+
+        case 'n':
+            puzzle_search_limits.second_node_max = atol(optarg);
+
+            break;
+
+        case 'd':
+            puzzle_search_limits.depth_max = atol(optarg);
+
+            break;
+
+        case 'l':
+            puzzle_search_limits.line_plies = atol(optarg);
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if (optind >= argc)
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (!puzzle_search_limits.second_node_max)
+        puzzle_search_limits.second_node_max = puzzle_search_limits.node_max / 4;
+
+    if (threads_num < 1)
+        threads_num = 1;
+    if (threads_num > PUZZLE_THREADS_MAX)
+        threads_num = PUZZLE_THREADS_MAX;
+
+    pthread_mutex_init(&puzzle_job_queue.mutex, NULL);
+    pthread_cond_init(&puzzle_job_queue.not_empty, NULL);
+    pthread_cond_init(&puzzle_job_queue.not_full, NULL);
+
+    pthread_t workers[PUZZLE_THREADS_MAX];
+
+    for (long i = 0; i < threads_num; i++)
+        pthread_create(&workers[i], NULL, puzzle_run_worker, NULL);
+
+    double start_time = get_time();
+    uint64_t games_num = 0;
+
+    // Games are streamed: the queue bounds the games held in memory
+    for (int i = optind; i < argc; i++)
+    {
+        pgn_reader reader;
+        if (!pgn_open(&reader, argv[i]))
+        {
+            fprintf(stderr, "Could not open %s\n", argv[i]);
+
+            continue;
+        }
+
+        while (true)
+        {
+            puzzle_job job;
+
+            job.game = malloc(sizeof(pgn_game));
+            if (!job.game)
+            {
+                fprintf(stderr, "Out of memory\n");
+
+                break;
+            }
+
+            if (!pgn_read_game(&reader, job.game))
+            {
+                free(job.game);
+
+                break;
+            }
+
+            job.index = games_num++;
+            puzzle_queue_push(&job);
+        }
+
+        pgn_close(&reader);
+    }
+
+    puzzle_queue_close();
+
+    for (long i = 0; i < threads_num; i++)
+        pthread_join(workers[i], NULL);
+
+    double total_time = get_time() - start_time;
+    const puzzle_stats *stats = &puzzle_total_stats;
+
+    fprintf(stderr,
+            "games %llu (invalid %llu) plies %llu candidates %llu puzzles %llu\n"
+            "searches %llu nodes %llu threads %ld\n"
+            "time %.3f s games/s %.1f\n",
+            (unsigned long long)stats->games_num,
+            (unsigned long long)stats->invalid_games_num,
+            (unsigned long long)stats->plies_num,
+            (unsigned long long)stats->candidates_num,
+            (unsigned long long)stats->puzzles_num,
+            (unsigned long long)stats->searches_num,
+            (unsigned long long)stats->nodes_num,
+            threads_num,
+            total_time,
+            total_time > 0 ? stats->games_num / total_time : 0);
+
+    return 0;
+}
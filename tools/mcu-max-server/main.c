@@ -0,0 +1,497 @@
+/*
+ * mcu-max binary analysis server
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "analysis.h"
+#include "cache.h"
+#include "polyglot.h"
+#include "throttle.h"
+
+#define SERVER_QUEUE_SIZE 1024
+#define SERVER_THREADS_MAX 256
+
+#define SERVER_NODE_MAX_DEFAULT 100000
+#define SERVER_DEPTH_MAX_DEFAULT 30
+
+// A client; freed when its reader and all its requests are done
+typedef struct
+{
+    int fd_in;
+    int fd_out;
+    bool is_socket;
+    pthread_mutex_t mutex;
+    uint32_t references_num;
+    bool write_failed;
+} server_connection;
+
+typedef struct
+{
+    server_connection *connection;
+    analysis_request request;
+    bool is_valid;
+} server_job;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    server_job jobs[SERVER_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t jobs_num;
+    bool done;
+} server_queue;
+
+static server_queue server_job_queue;
+
+static cache server_cache;
+static bool server_is_cached;
+
+static uint32_t server_nps_max;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static server_connection *server_connection_create(int fd_in, int fd_out, bool is_socket)
+{
+    server_connection *connection = calloc(1, sizeof(server_connection));
+    if (!connection)
+        return NULL;
+
+    connection->fd_in = fd_in;
+    connection->fd_out = fd_out;
+    connection->is_socket = is_socket;
+    connection->references_num = 1;
+    pthread_mutex_init(&connection->mutex, NULL);
+
+    return connection;
+}
+
+static void server_connection_acquire(server_connection *connection)
+{
+    pthread_mutex_lock(&connection->mutex);
+    connection->references_num++;
+    pthread_mutex_unlock(&connection->mutex);
+}
+
+static void server_connection_release(server_connection *connection)
+{
+    pthread_mutex_lock(&connection->mutex);
+    bool is_last = !--connection->references_num;
+    pthread_mutex_unlock(&connection->mutex);
+
+    if (!is_last)
+        return;
+
+    if (connection->is_socket)
+        close(connection->fd_in);
+    pthread_mutex_destroy(&connection->mutex);
+    free(connection);
+}
+
+static void server_send_response(server_connection *connection,
+                                 const analysis_response *response)
+{
+    uint8_t frame[4 + ANALYSIS_RESPONSE_SIZE];
+    size_t frame_size = analysis_encode_response(response, frame);
+
+    pthread_mutex_lock(&connection->mutex);
+    if (!connection->write_failed &&
+        !analysis_write(connection->fd_out, frame, frame_size))
+        connection->write_failed = true;
+    pthread_mutex_unlock(&connection->mutex);
+}
+
+static void server_queue_push(const server_job *job)
+{
+    server_queue *queue = &server_job_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->jobs_num == SERVER_QUEUE_SIZE)
+        pthread_cond_wait(&queue->not_full, &queue->mutex);
+
+    queue->jobs[(queue->head + queue->jobs_num) % SERVER_QUEUE_SIZE] = *job;
+    queue->jobs_num++;
+
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static void server_queue_close(void)
+{
+    server_queue *queue = &server_job_queue;
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->done = true;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->mutex);
+}
+
+static bool server_queue_pop(server_job *job)
+{
+    server_queue *queue = &server_job_queue;
+    bool is_popped = false;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (!queue->jobs_num && !queue->done)
+        pthread_cond_wait(&queue->not_empty, &queue->mutex);
+
+    if (queue->jobs_num)
+    {
+        *job = queue->jobs[queue->head];
+        queue->head = (queue->head + 1) % SERVER_QUEUE_SIZE;
+        queue->jobs_num--;
+        is_popped = true;
+
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return is_popped;
+}
+
+// Searches a request with the calling thread's engine
+static void server_analyze(const server_job *job, throttle *throttle,
+                           analysis_response *response)
+{
+    const analysis_request *request = &job->request;
+    char fen[ANALYSIS_FEN_SIZE];
+
+    memset(response, 0, sizeof(*response));
+    response->id = request->id;
+    response->move = MCUMAX_MOVE_INVALID;
+
+    if (!job->is_valid ||
+        !analysis_unpack_fen(&request->position, fen))
+    {
+        response->status = ANALYSIS_STATUS_INVALID_REQUEST;
+
+        return;
+    }
+
+    uint32_t node_max = request->node_max ? request->node_max : SERVER_NODE_MAX_DEFAULT;
+    uint8_t depth_max = request->depth_max ? request->depth_max : SERVER_DEPTH_MAX_DEFAULT;
+    bool is_bounded = (request->score_max < ANALYSIS_SCORE_MAX);
+    int32_t score_max = !is_bounded
+                            ? ANALYSIS_SCORE_MAX
+                        : (request->score_max > -ANALYSIS_SCORE_MAX)
+                            ? request->score_max
+                            : -ANALYSIS_SCORE_MAX + 1;
+
+    double start_time = get_time();
+
+    mcumax_set_fen_position(fen);
+
+    // Repeated positions cost a lookup instead of a search
+    uint64_t key = 0;
+    cache_entry entry;
+
+    if (server_is_cached)
+    {
+        key = polyglot_get_key();
+
+        if (cache_lookup(&server_cache, key, node_max, depth_max, &entry))
+        {
+            response->flags = ANALYSIS_FLAG_CACHED;
+            response->move.from = entry.from;
+            response->move.to = entry.to;
+            response->score = entry.score;
+            response->depth = entry.depth;
+            response->nodes_num = entry.nodes_num;
+            response->time_us = 1E6 * (get_time() - start_time);
+
+            return;
+        }
+    }
+
+    mcumax_move move;
+    if (!mcumax_search_valid_moves(&move, 1))
+        response->status = ANALYSIS_STATUS_NO_MOVES;
+    else
+    {
+        throttle_start(throttle);
+        response->move = mcumax_search_best_move_bounded(node_max, depth_max, score_max);
+        response->score = mcumax.search_score;
+        if (is_bounded &&
+            (response->score >= score_max - 1))
+            response->flags = ANALYSIS_FLAG_LOWER_BOUND;
+        response->depth = mcumax.search_depth;
+        response->nodes_num = mcumax.node_count;
+        if ((response->move.from == MCUMAX_SQUARE_INVALID) &&
+            !(response->flags & ANALYSIS_FLAG_LOWER_BOUND))
+            response->status = ANALYSIS_STATUS_NO_MOVES;
+    }
+
+    response->time_us = 1E6 * (get_time() - start_time);
+
+    // Only exact results answer later requests
+    if (server_is_cached &&
+        !is_bounded &&
+        (response->status == ANALYSIS_STATUS_OK))
+    {
+        entry.key = key;
+        entry.score = response->score;
+        entry.nodes_num = response->nodes_num;
+        entry.node_max = node_max;
+        entry.from = response->move.from;
+        entry.to = response->move.to;
+        entry.depth = response->depth;
+        entry.depth_max = depth_max;
+
+        cache_store(&server_cache, &entry);
+    }
+}
+
+// Each worker thread owns one engine (the engine state is thread-local)
+static void *server_run_worker(void *arg)
+{
+    (void)arg;
+
+    server_job job;
+    throttle throttle;
+
+    throttle_init(&throttle, server_nps_max);
+
+    while (server_queue_pop(&job))
+    {
+        analysis_response response;
+
+        server_analyze(&job, &throttle, &response);
+        server_send_response(job.connection, &response);
+        server_connection_release(job.connection);
+    }
+
+    return NULL;
+}
+
+// Queues a connection's requests until end of file
+static void *server_run_reader(void *arg)
+{
+    server_connection *connection = arg;
+    uint8_t payload[ANALYSIS_FRAME_SIZE_MAX];
+    uint32_t payload_size;
+
+    while (analysis_read_frame(connection->fd_in, payload, &payload_size))
+    {
+        server_job job;
+
+        memset(&job, 0, sizeof(job));
+        job.connection = connection;
+        job.is_valid = analysis_decode_request(payload, payload_size, &job.request);
+
+        server_connection_acquire(connection);
+        server_queue_push(&job);
+    }
+
+    server_connection_release(connection);
+
+    return NULL;
+}
+
+static int server_listen(const char *path)
+{
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) ||
+        listen(fd, SOMAXCONN))
+    {
+        close(fd);
+
+        return -1;
+    }
+
+    return fd;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-server [-t threads] [-s socket] [-c cache] [-e entries]\n"
+            "                      [-R nps]\n"
+            "\n"
+            "Serves binary analysis requests (see tools/common/analysis.h) from stdin\n"
+            "to stdout, or from the clients of a Unix socket.\n"
+            "\n"
+            "  -t  Engine threads (default: number of CPUs)\n"
+            "  -s  Unix socket path\n"
+            "  -c  Persistent result cache, created if missing\n"
+            "  -e  Entries of a new cache (default: %d)\n"
+            "  -R  Nodes per second per engine thread; throttled threads sleep, so\n"
+            "      more threads than CPUs can share the CPUs predictably\n",
+            CACHE_CAPACITY_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = NULL;
+    const char *cache_path = NULL;
+    uint32_t cache_capacity = CACHE_CAPACITY_DEFAULT;
+    long threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int option;
+    while ((option = getopt(argc, argv, "t:s:c:e:R:")) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            threads_num = atol(optarg);
+
+            break;
+
+        case 's':
+            socket_path = optarg;
+
+            break;
+
+        case 'c':
+            cache_path = optarg;
+
+            break;
+
+        case 'e':
+            cache_capacity = atol(optarg);
+
+            break;
+
+        case 'R':
+            server_nps_max = atol(optarg);
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if (optind < argc)
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (threads_num < 1)
+        threads_num = 1;
+    if (threads_num > SERVER_THREADS_MAX)
+        threads_num = SERVER_THREADS_MAX;
+
+    if (cache_path)
+    {
+        if (!cache_open(&server_cache, cache_path, cache_capacity))
+        {
+            fprintf(stderr, "Could not open cache %s\n", cache_path);
+
+            return 1;
+        }
+
+        polyglot_init_random(CACHE_KEY_SEED);
+        server_is_cached = true;
+    }
+
+    // Clients that disconnect early must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&server_job_queue.mutex, NULL);
+    pthread_cond_init(&server_job_queue.not_empty, NULL);
+    pthread_cond_init(&server_job_queue.not_full, NULL);
+
+    pthread_t workers[SERVER_THREADS_MAX];
+
+    for (long i = 0; i < threads_num; i++)
+        pthread_create(&workers[i], NULL, server_run_worker, NULL);
+
+    if (!socket_path)
+    {
+        server_connection *connection = server_connection_create(STDIN_FILENO, STDOUT_FILENO, false);
+        if (!connection)
+        {
+            fprintf(stderr, "Out of memory\n");
+
+            return 1;
+        }
+
+        server_run_reader(connection);
+
+        // Answer the pending requests, then exit
+        server_queue_close();
+
+        for (long i = 0; i < threads_num; i++)
+            pthread_join(workers[i], NULL);
+
+        if (server_is_cached)
+        {
+            fprintf(stderr, "cache hits %llu misses %llu stores %llu\n",
+                    (unsigned long long)server_cache.hits_num,
+                    (unsigned long long)server_cache.misses_num,
+                    (unsigned long long)server_cache.stores_num);
+
+            cache_close(&server_cache);
+        }
+
+        return 0;
+    }
+
+    int listen_fd = server_listen(socket_path);
+    if (listen_fd < 0)
+    {
+        fprintf(stderr, "Could not listen on %s\n", socket_path);
+
+        return 1;
+    }
+
+    fprintf(stderr, "listening on %s with %ld threads\n", socket_path, threads_num);
+
+    while (true)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        server_connection *connection = server_connection_create(fd, fd, true);
+        pthread_t reader;
+
+        if (!connection ||
+            pthread_create(&reader, NULL, server_run_reader, connection))
+        {
+            free(connection);
+            close(fd);
+
+            continue;
+        }
+
+        pthread_detach(reader);
+    }
+}
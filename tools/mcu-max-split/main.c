@@ -0,0 +1,678 @@
+/*
+ * mcu-max multi-process root-split analysis coordinator
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "analysis.h"
+#include "pgn.h"
+
+#define SPLIT_WORKERS_MAX 64
+#define SPLIT_MOVES_MAX 256
+#define SPLIT_ARGS_MAX 64
+#define SPLIT_ARG_SIZE 256
+
+// Scores are only set from the third iteration on (see mcumax_search_best_move())
+#define SPLIT_CHILD_DEPTH_MIN 3
+
+#define SPLIT_DEPTH_MAX_DEFAULT 7
+#define SPLIT_WORKERS_NUM_DEFAULT 2
+
+// Mate scores count plies from the mate, not from the material
+#define SPLIT_SCORE_MATE 8000
+#define SPLIT_SCORE_MATE_MIN 7000
+
+static const char *split_default_fen =
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4";
+
+typedef struct
+{
+    int fd_in;
+    int fd_out;
+    pid_t pid;
+
+    int32_t move_index;
+    uint32_t depth;
+    double start_time;
+} split_worker;
+
+typedef struct
+{
+    mcumax_move move;
+    analysis_position position;
+    bool is_terminal;
+
+    // Quiet non-pawn moves after the first are searched one ply shallower,
+    // and again at full depth if they beat alpha (as the engine's root does)
+    bool is_reducible;
+    bool is_research_pending;
+
+    // Material score of the position after the move, for its side to move
+    int32_t base;
+
+    int32_t score;
+    bool is_bound;
+    uint32_t nodes_num;
+} split_move;
+
+static split_worker split_workers[SPLIT_WORKERS_MAX];
+static uint32_t split_workers_num;
+
+static split_move split_moves[SPLIT_MOVES_MAX];
+static uint32_t split_order[SPLIT_MOVES_MAX];
+static uint32_t split_moves_num;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+static int split_connect(const char *path)
+{
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return -1;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        close(fd);
+
+        return -1;
+    }
+
+    return fd;
+}
+
+// Starts a worker on the other end of two pipes; "%d" in the command is
+// replaced by the worker index, e.g. for pinning with taskset or numactl
+static pid_t split_spawn(char **command, uint32_t index, int *fd_in, int *fd_out)
+{
+    static char args[SPLIT_ARGS_MAX][SPLIT_ARG_SIZE];
+    char *argv[SPLIT_ARGS_MAX + 1];
+    uint32_t args_num = 0;
+
+    for (; command[args_num] && (args_num < SPLIT_ARGS_MAX); args_num++)
+    {
+        const char *arg = command[args_num];
+        const char *index_arg = strstr(arg, "%d");
+
+        if (index_arg)
+            snprintf(args[args_num], SPLIT_ARG_SIZE, "%.*s%u%s",
+                     (int)(index_arg - arg), arg, index, index_arg + 2);
+        else
+            snprintf(args[args_num], SPLIT_ARG_SIZE, "%s", arg);
+
+        argv[args_num] = args[args_num];
+    }
+    argv[args_num] = NULL;
+
+    int request_pipe[2];
+    int response_pipe[2];
+
+    if (pipe(request_pipe))
+        return -1;
+    if (pipe(response_pipe))
+    {
+        close(request_pipe[0]);
+        close(request_pipe[1]);
+
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (!pid)
+    {
+        dup2(request_pipe[0], STDIN_FILENO);
+        dup2(response_pipe[1], STDOUT_FILENO);
+        close(request_pipe[0]);
+        close(request_pipe[1]);
+        close(response_pipe[0]);
+        close(response_pipe[1]);
+
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    close(request_pipe[0]);
+    close(response_pipe[1]);
+
+    *fd_out = request_pipe[1];
+    *fd_in = response_pipe[0];
+
+    return pid;
+}
+
+// Sets up the root moves and the positions after them
+static bool split_set_moves(const char *fen)
+{
+    mcumax_move moves[SPLIT_MOVES_MAX];
+
+    mcumax_set_fen_position(fen);
+    split_moves_num = mcumax_search_valid_moves(moves, SPLIT_MOVES_MAX);
+
+    for (uint32_t i = 0; i < split_moves_num; i++)
+    {
+        split_move *move = &split_moves[i];
+        char child_fen[PGN_FEN_SIZE];
+
+        memset(move, 0, sizeof(*move));
+        move->move = moves[i];
+        split_order[i] = i;
+
+        mcumax_set_fen_position(fen);
+        move->is_reducible = ((mcumax_get_piece(moves[i].from) & 0b111) > MCUMAX_PAWN_DOWNSTREAM) &&
+                             !(mcumax_get_piece(moves[i].to) & 0b111);
+        mcumax_play_move(moves[i]);
+
+        // Searches from FEN start at score 0: the base keeps the material
+        // won by the move
+        move->base = mcumax.score;
+
+        if (!mcumax_search_valid_moves(NULL, 0))
+        {
+            move->is_terminal = true;
+            move->score = mcumax_is_in_check(mcumax_get_current_side())
+                              ? SPLIT_SCORE_MATE
+                              : 0;
+        }
+
+        mcumax_get_fen(child_fen, PGN_FEN_SIZE);
+        if (!analysis_pack_fen(child_fen, &move->position))
+            return false;
+    }
+
+    mcumax_set_fen_position(fen);
+
+    return split_moves_num > 0;
+}
+
+// Best exact root score of the current iteration
+static int32_t split_alpha;
+
+static bool split_send(split_worker *worker, uint32_t move_index,
+                       uint32_t depth, uint32_t node_max)
+{
+    const split_move *move = &split_moves[move_index];
+    analysis_request request;
+    uint8_t frame[4 + ANALYSIS_REQUEST_SIZE];
+
+    // The move only matters if it beats alpha: the search after it may
+    // stop as soon as the opponent reaches -alpha
+    int32_t score_max = -split_alpha - move->base;
+
+    request.id = move_index;
+    request.node_max = node_max;
+    request.depth_max = depth;
+    request.score_max = (score_max < -ANALYSIS_SCORE_MAX + 1)
+                            ? -ANALYSIS_SCORE_MAX + 1
+                        : (score_max > ANALYSIS_SCORE_MAX)
+                            ? ANALYSIS_SCORE_MAX
+                            : score_max;
+    request.position = move->position;
+
+    worker->move_index = move_index;
+    worker->depth = depth;
+    worker->start_time = get_time();
+
+    size_t frame_size = analysis_encode_request(&request, frame);
+
+    return analysis_write(worker->fd_out, frame, frame_size);
+}
+
+static bool split_receive(split_worker *worker, uint32_t child_depth, double *busy_time)
+{
+    uint8_t payload[ANALYSIS_FRAME_SIZE_MAX];
+    uint32_t payload_size;
+    analysis_response response;
+
+    if (!analysis_read_frame(worker->fd_in, payload, &payload_size) ||
+        !analysis_decode_response(payload, payload_size, &response) ||
+        (response.id != (uint32_t)worker->move_index) ||
+        (response.status != ANALYSIS_STATUS_OK))
+        return false;
+
+    split_move *move = &split_moves[worker->move_index];
+    int32_t score = response.score;
+
+    if ((score < SPLIT_SCORE_MATE_MIN) &&
+        (score > -SPLIT_SCORE_MATE_MIN))
+        score += move->base;
+
+    move->score = -score;
+    move->is_bound = !!(response.flags & ANALYSIS_FLAG_LOWER_BOUND);
+    move->nodes_num += response.nodes_num;
+
+    if (!move->is_bound)
+    {
+        if (worker->depth < child_depth)
+            move->is_research_pending = true;
+        else if (move->score > split_alpha)
+            split_alpha = move->score;
+    }
+
+    *busy_time += get_time() - worker->start_time;
+    worker->move_index = -1;
+
+    return true;
+}
+
+// Exact scores first, as refuted moves only have upper bounds
+static int split_compare_scores(const void *a, const void *b)
+{
+    uint32_t index_a = *(const uint32_t *)a;
+    uint32_t index_b = *(const uint32_t *)b;
+    const split_move *move_a = &split_moves[index_a];
+    const split_move *move_b = &split_moves[index_b];
+    int32_t score_a = move_a->score;
+    int32_t score_b = move_b->score;
+
+    if (move_a->is_bound != move_b->is_bound)
+        return move_a->is_bound - move_b->is_bound;
+
+    if (score_a != score_b)
+        return (score_a < score_b) - (score_a > score_b);
+
+    return (index_a > index_b) - (index_a < index_b);
+}
+
+// Searches all root moves with the given workers. The best move of the last
+// iteration is searched first, to set alpha (young brothers wait); then idle
+// workers take the next move, best moves first, so the load rebalances as
+// searches finish and iterations deepen.
+static bool split_run_iteration(uint32_t workers_num, uint32_t child_depth,
+                                uint32_t node_max, double *busy_time)
+{
+    qsort(split_order, split_moves_num, sizeof(uint32_t), split_compare_scores);
+
+    split_alpha = -ANALYSIS_SCORE_MAX;
+
+    for (uint32_t i = 0; i < split_moves_num; i++)
+    {
+        split_moves[i].nodes_num = 0;
+
+        if (split_moves[i].is_terminal &&
+            (split_moves[i].score > split_alpha))
+            split_alpha = split_moves[i].score;
+    }
+
+    uint32_t next = 0;
+    uint32_t pending_num = 0;
+    bool is_eldest_searched = false;
+
+    while (true)
+    {
+        for (uint32_t i = 0; i < workers_num; i++)
+        {
+            split_worker *worker = &split_workers[i];
+
+            if (worker->move_index >= 0)
+                continue;
+
+            // Re-searches first: they may raise alpha
+            uint32_t move_index = split_moves_num;
+            uint32_t depth = child_depth;
+
+            for (uint32_t j = 0; j < next; j++)
+            {
+                if (split_moves[split_order[j]].is_research_pending)
+                {
+                    move_index = split_order[j];
+                    split_moves[move_index].is_research_pending = false;
+
+                    break;
+                }
+            }
+
+            if (move_index == split_moves_num)
+            {
+                while ((next < split_moves_num) &&
+                       split_moves[split_order[next]].is_terminal)
+                    next++;
+                if ((next == split_moves_num) ||
+                    (pending_num && !is_eldest_searched))
+                    continue;
+
+                move_index = split_order[next++];
+                if (is_eldest_searched &&
+                    split_moves[move_index].is_reducible &&
+                    (child_depth > SPLIT_CHILD_DEPTH_MIN))
+                    depth = child_depth - 1;
+            }
+
+            if (!split_send(worker, move_index, depth, node_max))
+                return false;
+
+            pending_num++;
+        }
+
+        if (!pending_num)
+            return true;
+
+        struct pollfd fds[SPLIT_WORKERS_MAX];
+
+        for (uint32_t i = 0; i < workers_num; i++)
+        {
+            fds[i].fd = (split_workers[i].move_index >= 0) ? split_workers[i].fd_in : -1;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+
+        if (poll(fds, workers_num, -1) < 0)
+            return false;
+
+        for (uint32_t i = 0; i < workers_num; i++)
+        {
+            if (!fds[i].revents)
+                continue;
+
+            if (!split_receive(&split_workers[i], child_depth, busy_time))
+                return false;
+
+            pending_num--;
+            is_eldest_searched = true;
+        }
+    }
+}
+
+// Refuted moves only have an upper bound, below the best exact score
+static uint32_t split_get_best_move(void)
+{
+    uint32_t best = split_moves_num;
+
+    for (uint32_t i = 0; i < split_moves_num; i++)
+        if (!split_moves[i].is_bound &&
+            ((best == split_moves_num) ||
+             (split_moves[i].score > split_moves[best].score)))
+            best = i;
+
+    return best;
+}
+
+// Deepens the root-split search; returns the elapsed time, negative on errors
+static double split_analyze(uint32_t workers_num, uint32_t depth_max, uint32_t node_max,
+                            bool is_verbose, uint64_t *nodes_num)
+{
+    double start_time = get_time();
+    double busy_time = 0;
+
+    *nodes_num = 0;
+
+    for (uint32_t i = 0; i < split_moves_num; i++)
+    {
+        split_order[i] = i;
+
+        if (!split_moves[i].is_terminal)
+        {
+            split_moves[i].score = 0;
+            split_moves[i].is_bound = false;
+        }
+    }
+
+    for (uint32_t child_depth = SPLIT_CHILD_DEPTH_MIN;
+         child_depth < depth_max;
+         child_depth++)
+    {
+        double iteration_start_time = get_time();
+        double iteration_busy_time = 0;
+
+        if (!split_run_iteration(workers_num, child_depth, node_max, &iteration_busy_time))
+            return -1;
+
+        double iteration_time = get_time() - iteration_start_time;
+        uint64_t iteration_nodes_num = 0;
+        uint32_t refuted_num = 0;
+
+        for (uint32_t i = 0; i < split_moves_num; i++)
+        {
+            iteration_nodes_num += split_moves[i].nodes_num;
+            refuted_num += split_moves[i].is_bound;
+        }
+
+        *nodes_num += iteration_nodes_num;
+        busy_time += iteration_busy_time;
+
+        if (is_verbose)
+        {
+            const split_move *best = &split_moves[split_get_best_move()];
+            char san[PGN_SAN_SIZE];
+
+            pgn_move_to_san(best->move, san);
+
+            printf("depth %2u  best %-8s score %6d  refuted %3u/%-3u  nodes %10llu  "
+                   "time %8.3f s  utilization %3.0f%%\n",
+                   child_depth + 1,
+                   san,
+                   best->score,
+                   refuted_num,
+                   split_moves_num,
+                   (unsigned long long)iteration_nodes_num,
+                   iteration_time,
+                   iteration_time > 0
+                       ? 100 * iteration_busy_time / (workers_num * iteration_time)
+                       : 0);
+        }
+    }
+
+    double total_time = get_time() - start_time;
+
+    if (is_verbose)
+        printf("workers %u  nodes %llu  time %.3f s  nodes/s %.0f  utilization %.0f%%\n",
+               workers_num,
+               (unsigned long long)*nodes_num,
+               total_time,
+               total_time > 0 ? *nodes_num / total_time : 0,
+               total_time > 0 ? 100 * busy_time / (workers_num * total_time) : 0);
+
+    return total_time;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-split [-w workers] [-d depth] [-N nodes] [-f fen] [-S]\n"
+            "                     -- server command...\n"
+            "       mcu-max-split [options] -s socket [-s socket]...\n"
+            "\n"
+            "Analyzes one position by splitting its root moves among worker processes\n"
+            "that speak the binary analysis protocol (e.g. mcu-max-server -t 1).\n"
+            "Each worker searches the position after a root move, bounded by the\n"
+            "best score so far; idle workers take the next move. In the server command, %%d is replaced by the worker\n"
+            "index, e.g.: -- taskset -c %%d mcu-max-server -t 1\n"
+            "Scores are for the side to move, relative to the position's material.\n"
+            "\n"
+            "  -w  Worker processes to start (default: %d)\n"
+            "  -s  Unix socket path of a running worker; one worker per -s\n"
+            "  -d  Depth (default: %d)\n"
+            "  -N  Node limit per root move and iteration (default: none)\n"
+            "  -f  Position (default: Italian game)\n"
+            "  -S  Report scaling: analyze with 1, 2, 4... workers\n",
+            SPLIT_WORKERS_NUM_DEFAULT,
+            SPLIT_DEPTH_MAX_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_paths[SPLIT_WORKERS_MAX];
+    uint32_t socket_paths_num = 0;
+    const char *fen = split_default_fen;
+    uint32_t workers_num = SPLIT_WORKERS_NUM_DEFAULT;
+    uint32_t depth_max = SPLIT_DEPTH_MAX_DEFAULT;
+    uint32_t node_max = UINT32_MAX;
+    bool is_scaling = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "w:s:d:N:f:S")) != -1)
+    {
+        switch (option)
+        {
+        case 'w':
+            workers_num = atol(optarg);
+
+            break;
+
+        case 's':
+            if (socket_paths_num < SPLIT_WORKERS_MAX)
+                socket_paths[socket_paths_num++] = optarg;
+
+            break;
+
+        case 'd':
+            depth_max = atol(optarg);
+
+            break;
+
+        case 'N':
+            node_max = atol(optarg);
+
+            break;
+
+        case 'f':
+            fen = optarg;
+
+            break;
+
+        case 'S':
+            is_scaling = true;
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if ((!socket_paths_num == (optind >= argc)) ||
+        (depth_max > 0xff) ||
+        !node_max)
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (socket_paths_num)
+        workers_num = socket_paths_num;
+    if (workers_num < 1)
+        workers_num = 1;
+    if (workers_num > SPLIT_WORKERS_MAX)
+        workers_num = SPLIT_WORKERS_MAX;
+
+    if (!split_set_moves(fen))
+    {
+        fprintf(stderr, "Invalid position or no moves: %s\n", fen);
+
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    for (uint32_t i = 0; i < workers_num; i++)
+    {
+        split_worker *worker = &split_workers[i];
+
+        worker->move_index = -1;
+        worker->pid = -1;
+
+        if (socket_paths_num)
+            worker->fd_in = worker->fd_out = split_connect(socket_paths[i]);
+        else
+            worker->pid = split_spawn(argv + optind, i, &worker->fd_in, &worker->fd_out);
+
+        if (socket_paths_num ? (worker->fd_in < 0) : (worker->pid < 0))
+        {
+            fprintf(stderr, "Could not start worker %u\n", i);
+
+            return 1;
+        }
+
+        split_workers_num++;
+    }
+
+    int status = 0;
+    uint64_t nodes_num;
+
+    if (!is_scaling)
+    {
+        if (split_analyze(workers_num, depth_max, node_max, true, &nodes_num) < 0)
+            status = 1;
+        else
+        {
+            char uci[6];
+
+            pgn_move_to_uci(split_moves[split_get_best_move()].move, uci);
+            printf("bestmove %s\n", uci);
+        }
+    }
+    else
+    {
+        double serial_time = 0;
+
+        for (uint32_t n = 1;; n = (2 * n < workers_num) ? 2 * n : workers_num)
+        {
+            double time = split_analyze(n, depth_max, node_max, false, &nodes_num);
+            if (time < 0)
+            {
+                status = 1;
+
+                break;
+            }
+
+            if (n == 1)
+                serial_time = time;
+
+            printf("workers %2u  time %8.3f s  nodes/s %10.0f  speedup %5.2f  "
+                   "efficiency %3.0f%%\n",
+                   n,
+                   time,
+                   time > 0 ? nodes_num / time : 0,
+                   time > 0 ? serial_time / time : 0,
+                   time > 0 ? 100 * serial_time / (n * time) : 0);
+
+            if (n == workers_num)
+                break;
+        }
+    }
+
+    if (status)
+        fprintf(stderr, "A worker failed\n");
+
+    for (uint32_t i = 0; i < split_workers_num; i++)
+    {
+        close(split_workers[i].fd_out);
+        if (split_workers[i].fd_in != split_workers[i].fd_out)
+            close(split_workers[i].fd_in);
+    }
+
+    for (uint32_t i = 0; i < split_workers_num; i++)
+        if (split_workers[i].pid > 0)
+            waitpid(split_workers[i].pid, NULL, 0);
+
+    return status;
+}
@@ -0,0 +1,368 @@
+/*
+ * mcu-max SPSA search parameter tuner
+ *
+ * (C) 2022-2024 Gissio
+ *
+ * License: MIT
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tune.h"
+
+#define TUNE_THREADS_MAX 256
+
+#define TUNE_PAIRS_DEFAULT 1000
+#define TUNE_NODE_MAX_DEFAULT 2000
+#define TUNE_DEPTH_MAX_DEFAULT 30
+#define TUNE_OPENING_PLIES_DEFAULT 8
+#define TUNE_RATE_DEFAULT 0.05
+#define TUNE_PROGRESS_DEFAULT 50
+
+// SPSA schedule exponents (Spall)
+#define TUNE_ALPHA 0.602
+#define TUNE_GAMMA 0.101
+
+typedef struct
+{
+    uint64_t pairs_num;
+    uint64_t wins_num;
+    uint64_t draws_num;
+    uint64_t losses_num;
+    uint64_t plies_num;
+    uint64_t nodes_num;
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    uint64_t skips_num;
+    uint64_t skip_nodes_num;
+#endif
+} tune_stats;
+
+static tune_limits tune_search_limits;
+static uint64_t tune_pairs_max = TUNE_PAIRS_DEFAULT;
+static uint64_t tune_seed;
+static double tune_rate = TUNE_RATE_DEFAULT;
+static uint64_t tune_progress = TUNE_PROGRESS_DEFAULT;
+
+// Guards the parameter estimate, the pair counter and the statistics
+static pthread_mutex_t tune_mutex = PTHREAD_MUTEX_INITIALIZER;
+static double tune_theta[sizeof(mcumax_params) / sizeof(int32_t)];
+static uint64_t tune_pairs_next;
+static tune_stats tune_total_stats;
+static double tune_start_time;
+
+static double get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+// Perturbation size of a parameter at pair k
+static double tune_get_c(uint32_t index, uint64_t k)
+{
+    return tune_params[index].step / pow(k + 1, TUNE_GAMMA);
+}
+
+// Learning rate at pair k; starts at -r and decays after the first tenth
+static double tune_get_r(uint64_t k)
+{
+    double a = 0.1 * tune_pairs_max;
+
+    return tune_rate * pow((a + 1) / (a + k + 1), TUNE_ALPHA);
+}
+
+static void tune_set_params(mcumax_params *params, const double *theta)
+{
+    mcumax_get_params(params);
+
+    for (uint32_t i = 0; i < tune_params_num; i++)
+        tune_set_param(params, i, (int32_t)lround(theta[i]));
+}
+
+static void print_theta(FILE *file)
+{
+    for (uint32_t i = 0; i < tune_params_num; i++)
+        fprintf(file, "%s%s=%.2f", i ? " " : "", tune_params[i].name, tune_theta[i]);
+    fprintf(file, "\n");
+}
+
+static void print_progress(void)
+{
+    const tune_stats *stats = &tune_total_stats;
+    double time = get_time() - tune_start_time;
+
+    fprintf(stderr, "pairs %llu +%llu =%llu -%llu plies %llu nodes/s %.0f\n",
+            (unsigned long long)stats->pairs_num,
+            (unsigned long long)stats->wins_num,
+            (unsigned long long)stats->draws_num,
+            (unsigned long long)stats->losses_num,
+            (unsigned long long)stats->plies_num,
+            time > 0 ? stats->nodes_num / time : 0);
+    print_theta(stderr);
+}
+
+static void tune_add_game(const tune_game *game, int32_t points, tune_stats *stats)
+{
+    stats->wins_num += (points > 0);
+    stats->draws_num += !points;
+    stats->losses_num += (points < 0);
+    stats->plies_num += game->plies_num;
+    stats->nodes_num += game->nodes_num;
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    stats->skips_num += game->skips_num;
+    stats->skip_nodes_num += game->skip_nodes_num;
+#endif
+}
+
+// Each worker thread owns one engine (the engine state is thread-local).
+// Pairs are asynchronous: each one perturbs the latest estimate.
+static void *tune_run_worker(void *arg)
+{
+    (void)arg;
+
+    while (true)
+    {
+        double theta[sizeof(tune_theta) / sizeof(tune_theta[0])];
+        int32_t delta[sizeof(tune_theta) / sizeof(tune_theta[0])];
+        uint64_t k;
+
+        pthread_mutex_lock(&tune_mutex);
+        k = tune_pairs_next;
+        if (k < tune_pairs_max)
+            tune_pairs_next++;
+        for (uint32_t i = 0; i < tune_params_num; i++)
+            theta[i] = tune_theta[i];
+        pthread_mutex_unlock(&tune_mutex);
+
+        if (k >= tune_pairs_max)
+            break;
+
+        // Simultaneous perturbation: a random sign per parameter
+        uint64_t state = (tune_seed + k) * 0x9e3779b97f4a7c15ULL + 1;
+        double theta_plus[sizeof(tune_theta) / sizeof(tune_theta[0])];
+        double theta_minus[sizeof(tune_theta) / sizeof(tune_theta[0])];
+
+        for (uint32_t i = 0; i < tune_params_num; i++)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+
+            delta[i] = (state >> 32) & 1 ? 1 : -1;
+            theta_plus[i] = theta[i] + tune_get_c(i, k) * delta[i];
+            theta_minus[i] = theta[i] - tune_get_c(i, k) * delta[i];
+        }
+
+        mcumax_params plus;
+        mcumax_params minus;
+
+        tune_set_params(&plus, theta_plus);
+        tune_set_params(&minus, theta_minus);
+
+        // The same opening with both colors
+        uint64_t opening_seed = (tune_seed << 32) + k;
+        while (!tune_set_opening(opening_seed, tune_search_limits.opening_plies))
+            opening_seed += tune_pairs_max;
+
+        mcumax_struct opening = mcumax;
+        tune_game games[2];
+
+        tune_play_game(&plus, &minus, &tune_search_limits, &games[0]);
+        mcumax = opening;
+        tune_play_game(&minus, &plus, &tune_search_limits, &games[1]);
+
+        int32_t result = games[0].result - games[1].result;
+
+        pthread_mutex_lock(&tune_mutex);
+
+        for (uint32_t i = 0; i < tune_params_num; i++)
+        {
+            const tune_param *param = &tune_params[i];
+
+            tune_theta[i] += tune_get_r(k) * tune_get_c(i, k) * result * delta[i];
+            if (tune_theta[i] < param->min)
+                tune_theta[i] = param->min;
+            if (tune_theta[i] > param->max)
+                tune_theta[i] = param->max;
+        }
+
+        tune_stats *stats = &tune_total_stats;
+        stats->pairs_num++;
+        tune_add_game(&games[0], games[0].result, stats);
+        tune_add_game(&games[1], -games[1].result, stats);
+
+        if (tune_progress && !(stats->pairs_num % tune_progress))
+            print_progress();
+
+        pthread_mutex_unlock(&tune_mutex);
+    }
+
+    return NULL;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "Usage: mcu-max-tune [-t threads] [-i pairs] [-N nodes] [-T ms] [-d depth]\n"
+            "                    [-o plies] [-r rate] [-s seed] [-p pairs]\n"
+            "\n"
+            "Tunes the search parameters with SPSA: each game pair plays the\n"
+            "parameters perturbed up and down against each other from a random\n"
+            "opening, both colors, and moves the estimate towards the winner.\n"
+            "Progress goes to stderr, the tuned parameters to stdout as #defines.\n"
+            "W/D/L are counted for the parameters perturbed up.\n"
+            "\n"
+            "  -t  Threads, one game each (default: number of CPUs)\n"
+            "  -i  Game pairs (default: %d)\n"
+            "  -N  Node limit per move (default: %d)\n"
+            "  -T  Soft time limit per move in ms, instead of the node limit\n"
+            "  -d  Depth limit per move (default: %d)\n"
+            "  -o  Random opening plies (default: %d)\n"
+            "  -r  Learning rate (default: %g)\n"
+            "  -s  Random seed (default: 0)\n"
+            "  -p  Progress interval in pairs, 0 for none (default: %d)\n",
+            TUNE_PAIRS_DEFAULT,
+            TUNE_NODE_MAX_DEFAULT,
+            TUNE_DEPTH_MAX_DEFAULT,
+            TUNE_OPENING_PLIES_DEFAULT,
+            TUNE_RATE_DEFAULT,
+            TUNE_PROGRESS_DEFAULT);
+}
+
+int main(int argc, char **argv)
+{
+    long threads_num = sysconf(_SC_NPROCESSORS_ONLN);
+
+    tune_search_limits.node_max = TUNE_NODE_MAX_DEFAULT;
+    tune_search_limits.depth_max = TUNE_DEPTH_MAX_DEFAULT;
+    tune_search_limits.opening_plies = TUNE_OPENING_PLIES_DEFAULT;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:i:N:T:d:o:r:s:p:")) != -1)
+    {
+        switch (option)
+        {
+        case 't':
+            threads_num = atol(optarg);
+
+            break;
+
+        case 'i':
+            tune_pairs_max = strtoull(optarg, NULL, 10);
+
+            break;
+
+        case 'N':
+            tune_search_limits.node_max = atol(optarg);
+
+            break;
+
+        case 'T':
+            tune_search_limits.time_max = atol(optarg);
+
+            break;
+
+        case 'd':
+            tune_search_limits.depth_max = atol(optarg);
+
+            break;
+
+        case 'o':
+            tune_search_limits.opening_plies = atol(optarg);
+
+            break;
+
+        case 'r':
+            tune_rate = atof(optarg);
+
+            break;
+
+        case 's':
+            tune_seed = strtoull(optarg, NULL, 10);
+
+            break;
+
+        case 'p':
+            tune_progress = strtoull(optarg, NULL, 10);
+
+            break;
+
+        default:
+            print_usage();
+
+            return 1;
+        }
+    }
+
+    if (optind < argc)
+    {
+        print_usage();
+
+        return 1;
+    }
+
+    if (threads_num < 1)
+        threads_num = 1;
+    if (threads_num > TUNE_THREADS_MAX)
+        threads_num = TUNE_THREADS_MAX;
+
+    // Start from the engine defaults
+    mcumax_params params;
+    mcumax_get_params(&params);
+    for (uint32_t i = 0; i < tune_params_num; i++)
+        tune_theta[i] = tune_get_param(&params, i);
+
+    fprintf(stderr, "start\n");
+    print_theta(stderr);
+
+    pthread_t workers[TUNE_THREADS_MAX];
+
+    tune_start_time = get_time();
+
+    for (long i = 0; i < threads_num; i++)
+        pthread_create(&workers[i], NULL, tune_run_worker, NULL);
+
+    for (long i = 0; i < threads_num; i++)
+        pthread_join(workers[i], NULL);
+
+    const tune_stats *stats = &tune_total_stats;
+    double total_time = get_time() - tune_start_time;
+
+    fprintf(stderr,
+            "pairs %llu games %llu (+%llu =%llu -%llu) plies %llu nodes %llu threads %ld\n"
+            "time %.3f s games/s %.2f nodes/s %.0f\n",
+            (unsigned long long)stats->pairs_num,
+            (unsigned long long)(2 * stats->pairs_num),
+            (unsigned long long)stats->wins_num,
+            (unsigned long long)stats->draws_num,
+            (unsigned long long)stats->losses_num,
+            (unsigned long long)stats->plies_num,
+            (unsigned long long)stats->nodes_num,
+            threads_num,
+            total_time,
+            total_time > 0 ? 2 * stats->pairs_num / total_time : 0,
+            total_time > 0 ? stats->nodes_num / total_time : 0);
+
+#ifdef MCUMAX_ITERATION_PREDICTION_ENABLED
+    // Time saved: the skipped iterations' predicted nodes at the measured
+    // speed of one thread
+    if (stats->pairs_num && stats->nodes_num)
+        fprintf(stderr,
+                "per game: skipped iterations %.2f predicted nodes %.0f time saved %.3f s\n",
+                (double)stats->skips_num / (2 * stats->pairs_num),
+                (double)stats->skip_nodes_num / (2 * stats->pairs_num),
+                threads_num * total_time * stats->skip_nodes_num /
+                    stats->nodes_num / (2 * stats->pairs_num));
+#endif
+
+    for (uint32_t i = 0; i < tune_params_num; i++)
+        printf("#define %s %ld\n", tune_params[i].macro, lround(tune_theta[i]));
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#!/bin/sh
+#
+# mcu-max size report
+#
+# Compiles src/mcu-max.c with -Os for each target whose toolchain is
+# installed, in the full and minimal (MCUMAX_MINIMAL_ENABLED) profiles, and
+# reports flash (text + data), static RAM (data + bss) and the stack frame
+# of the interior node search, which is used once per ply: mcumax_search()
+# with MCUMAX_SPECIALIZED_SEARCH_ENABLED, mcumax_search_node() otherwise.
+#
+# With -f or -r, fails if the minimal profile exceeds the flash or static
+# RAM budget. A budget applies to every target, or to one target when given
+# as target=bytes; the options can be repeated.
+#
+# (C) 2022-2024 Gissio
+#
+# License: MIT
+#
+
+usage()
+{
+    echo "Usage: size-report.sh [-f [target=]flash budget] [-r [target=]RAM budget] [target...]" >&2
+    echo "Targets: host (\$CC), avr (ATmega328P), arm (Cortex-M0+), rv32 (RV32IMC)" >&2
+    exit 1
+}
+
+flash_budgets=
+ram_budgets=
+
+# Prints the budget of a target: its own, else the one of every target
+get_budget()
+{
+    budget=
+    for entry in $2; do
+        case $entry in
+        "$1"=*) budget=${entry#*=} ;;
+        *=*) ;;
+        *) [ -z "$budget" ] && budget=$entry ;;
+        esac
+    done
+    echo "$budget"
+}
+
+while getopts "f:r:" option; do
+    case $option in
+    f) flash_budgets="$flash_budgets $OPTARG" ;;
+    r) ram_budgets="$ram_budgets $OPTARG" ;;
+    *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+targets=${*:-"host avr arm rv32"}
+
+source_dir=$(cd "$(dirname "$0")/../src" && pwd)
+build_dir=$(mktemp -d)
+trap 'rm -rf "$build_dir"' EXIT
+
+status=0
+
+printf "%-6s %-8s %8s %8s %8s\n" target profile flash ram stack/ply
+
+for target in $targets; do
+    case $target in
+    host)
+        cc=${CC:-cc}
+        size=size
+        flags=
+        ;;
+    avr)
+        cc=avr-gcc
+        size=avr-size
+        flags="-mmcu=atmega328p"
+        ;;
+    arm)
+        cc=arm-none-eabi-gcc
+        size=arm-none-eabi-size
+        flags="-mcpu=cortex-m0plus -mthumb"
+        ;;
+    rv32)
+        cc=riscv64-unknown-elf-gcc
+        size=riscv64-unknown-elf-size
+        flags="-march=rv32imc -mabi=ilp32"
+        ;;
+    *)
+        usage
+        ;;
+    esac
+
+    if ! command -v "$cc" >/dev/null 2>&1; then
+        printf "%-6s (%s not found)\n" "$target" "$cc"
+        continue
+    fi
+
+    for profile in full minimal; do
+        defines=
+        [ $profile = minimal ] && defines=-DMCUMAX_MINIMAL_ENABLED
+
+        object="$build_dir/$target-$profile.o"
+
+        # shellcheck disable=SC2086
+        if ! (cd "$build_dir" &&
+            $cc $flags $defines -std=c99 -Os -ffunction-sections -fdata-sections \
+                -fstack-usage -I"$source_dir" -c "$source_dir/mcu-max.c" \
+                -o "$object"); then
+            status=1
+            continue
+        fi
+
+        # Berkeley format: text data bss
+        set -- $($size "$object" | tail -n 1)
+        flash=$(($1 + $2))
+        ram=$(($2 + $3))
+        stack=$(awk -F '\t' '$1 ~ /:mcumax_search(_node)?$/ { print $2 }' \
+            "${object%.o}.su")
+
+        printf "%-6s %-8s %8d %8d %8s\n" "$target" $profile $flash $ram "${stack:-?}"
+
+        if [ $profile = minimal ]; then
+            flash_max=$(get_budget "$target" "$flash_budgets")
+            ram_max=$(get_budget "$target" "$ram_budgets")
+
+            if [ -n "$flash_max" ] && [ $flash -gt "$flash_max" ]; then
+                echo "$target: flash $flash exceeds budget $flash_max" >&2
+                status=1
+            fi
+            if [ -n "$ram_max" ] && [ $ram -gt "$ram_max" ]; then
+                echo "$target: RAM $ram exceeds budget $ram_max" >&2
+                status=1
+            fi
+        fi
+    done
+done
+
+exit $status